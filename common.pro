@@ -11,6 +11,7 @@ QT += xml
 
 unix {
   DEFINES+=PLATFORM_LINUX      # of course PLATFORM_BSD is more appropriate to some unices
+  LIBS+=-ldl                   # FunctionCompiler loads native kernels with dlopen
 }
 
 macx {
@@ -37,6 +37,7 @@
 #include "platform_specific.h"
 
 #include "evolvotron_main.h"
+#include "mutatable_image_computer_trace.h"
 
 //! Application code
 int main(int argc,char* argv[])
@@ -89,9 +90,13 @@ int main(int argc,char* argv[])
   bool debug;
   bool enlargement_threadpool;
   std::string favourite;
+  uint memory_cap;
   int niceness_enlargement;
-  int niceness_grid;
+  int niceness;
+  bool profile;
+  std::string stats;
   uint threads;
+  std::string trace;
   bool unwrapped;
   bool verbose;
 
@@ -100,13 +105,18 @@ int main(int argc,char* argv[])
     using namespace boost::program_options;
     advanced_options_desc.add_options()
       ("debug,D"                 ,bool_switch(&debug)                    ,"Enable function debug mode")
-      ("enlargement-threadpool,E",bool_switch(&enlargement_threadpool)   ,"Enlargements computed using a separate threadpool")
-      ("nice,n"                  ,value<int>(&niceness_grid)->default_value(4)
-       ,"Niceness of compute threads for image grid")
+      ("enlargement-threadpool,E",bool_switch(&enlargement_threadpool)   ,"Obsolete (ignored): enlargements share the thread pool")
+      ("memory-cap"              ,value<uint>(&memory_cap)->default_value(0)
+       ,"Soft memory cap in MB (0 for none): over it, unseen images and undo history are released")
+      ("nice,n"                  ,value<int>(&niceness)->default_value(4)
+       ,"Niceness of compute threads")
       ("Nice,N"                  ,value<int>(&niceness_enlargement)->default_value(8)
-       ,"Niceness of compute threads for enlargements (if separate pool)")
+       ,"Obsolete (ignored)")
+      ("profile"                 ,bool_switch(&profile)                  ,"Profile function evaluation (see image properties)")
+      ("stats"                   ,value<std::string>(&stats)             ,"Write compute statistics to file every second (JSON lines)")
       ("threads,t"               ,value<uint>(&threads)->default_value(get_number_of_processors())
-       ,"Number of threads in a thread pool")
+       ,"Number of compute threads")
+      ("trace"                   ,value<std::string>(&trace)             ,"Record compute task timeline to file (Chrome trace JSON) on exit")
       ("unwrapped,u"             ,bool_switch(&unwrapped)                ,"Don't wrap favourite function")
       ("verbose,v"               ,bool_switch(&verbose)                  ,"Log some details to stderr")
       ("favourite,x"             ,value<std::string>(&favourite)         ,"Favourite function")
@@ -185,12 +195,25 @@ int main(int argc,char* argv[])
     << rows 
     << " display cells and " 
     << threads
-    << " compute threads per farm (niceness "
-    << niceness_grid
-    << " and "
-    << niceness_enlargement
+    << " compute threads (niceness "
+    << niceness
     << ")\n";
 
+  if (enlargement_threadpool || !options["Nice"].defaulted())
+    {
+      std::cerr << "Options -E and -N are obsolete and ignored: enlargements share the compute threads with the grid (see Settings/Render parameters)\n";
+    }
+
+  FunctionProfile::enable(profile);
+
+  MemoryAccount::cap(1048576ULL*memory_cap);
+
+  if (!trace.empty())
+    {
+      MutatableImageComputerTrace::start(trace);
+      MutatableImageComputerTrace::name_thread("GUI");
+    }
+
   if (!startup.empty()) {
     std::clog << "Startup functions to be loaded: ";
     for (size_t i=0;i<startup.size();++i) {
@@ -207,9 +230,7 @@ int main(int argc,char* argv[])
        frames,
        framerate,
        threads,
-       enlargement_threadpool,
-       niceness_grid,
-       niceness_enlargement,
+       niceness,
        fullscreen,
        menuhide,
        autocool,
@@ -219,7 +240,8 @@ int main(int argc,char* argv[])
        linear,
        spheremap,
        startup,
-       startup_shuffle
+       startup_shuffle,
+       time(0)
        );
 
   main_widget->mutation_parameters().function_registry().status(std::clog);
@@ -240,6 +262,12 @@ int main(int argc,char* argv[])
 
       main_widget->favourite_function_unwrapped(unwrapped);
     }
+
+  if (!stats.empty() && !main_widget->stats_file(stats))
+    {
+      std::cerr << "Couldn't open statistics file " << stats << "\n";
+      return 1;
+    }
   
   main_widget->show();
   
@@ -0,0 +1,742 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Microbenchmarks for evolvotron internals.
+  Results are written to stdout as JSON so runs can be compared by script.
+*/
+
+#include "evolvotron_benchmark_precompiled.h"
+
+#include "evolvotron_main.h"
+#include "function_cost.h"
+#include "function_node.h"
+#include "function_registration.h"
+#include "function_registry.h"
+#include "function_top.h"
+#include "mutatable_image.h"
+#include "mutatable_image_display.h"
+#include "mutation_parameters.h"
+#include "platform_specific.h"
+#include "random.h"
+#include "transform_factory.h"
+
+//! Simple wall-clock timer reporting seconds.
+class Stopwatch
+{
+ public:
+  Stopwatch()
+    {
+      _timer.start();
+    }
+  double seconds() const
+    {
+      return 1e-9*_timer.nsecsElapsed();
+    }
+ private:
+  QElapsedTimer _timer;
+};
+
+//! Write a JSON object member "name":value (with a leading comma unless first).
+template <typename T> void json_member(std::ostream& out,bool& first,const std::string& name,const T& value)
+{
+  out << (first ? "" : ",") << "\"" << name << "\":" << value;
+  first=false;
+}
+
+//! Compare the alias table function picking with the std::map lower_bound lookup it replaced.
+/*! Also reports the largest difference in pick frequency between the two methods as a sanity check.
+ */
+void benchmark_pick(std::ostream& out,MutationParameters& mutation_parameters,uint seed,uint n)
+{
+  // Rebuild the cumulative map the old way for reference
+  std::map<real,const FunctionRegistration*> cumulative;
+  {
+    const FunctionRegistry::Registrations& registrations=mutation_parameters.function_registry().registrations();
+    real total=0.0;
+    for (FunctionRegistry::Registrations::const_iterator it=registrations.begin();it!=registrations.end();it++)
+      total+=mutation_parameters.get_weighting(it->second);
+    real normalised=0.0;
+    for (FunctionRegistry::Registrations::const_iterator it=registrations.begin();it!=registrations.end();it++)
+      {
+	normalised+=mutation_parameters.get_weighting(it->second)/total;
+	cumulative.insert(std::make_pair(normalised,it->second));
+      }
+  }
+
+  std::map<const FunctionRegistration*,uint> counts_alias;
+  std::map<const FunctionRegistration*,uint> counts_map;
+
+  Stopwatch alias_time;
+  for (uint i=0;i<n;i++)
+    counts_alias[mutation_parameters.random_weighted_function_registration()]++;
+  const double alias_seconds=alias_time.seconds();
+
+  Random01 r01(seed);
+  Stopwatch map_time;
+  for (uint i=0;i<n;i++)
+    {
+      std::map<real,const FunctionRegistration*>::const_iterator it=cumulative.lower_bound(r01());
+      counts_map[(it!=cumulative.end() ? it : --cumulative.end())->second]++;
+    }
+  const double map_seconds=map_time.seconds();
+
+  real max_frequency_difference=0.0;
+  for (std::map<real,const FunctionRegistration*>::const_iterator it=cumulative.begin();it!=cumulative.end();it++)
+    {
+      max_frequency_difference=std::max
+	(
+	 max_frequency_difference,
+	 static_cast<real>(fabs(static_cast<real>(counts_alias[it->second])-static_cast<real>(counts_map[it->second])))/n
+	 );
+    }
+
+  bool first=true;
+  out << "{";
+  json_member(out,first,"name",std::string("\"pick\""));
+  json_member(out,first,"picks",n);
+  json_member(out,first,"functions",cumulative.size());
+  json_member(out,first,"alias_picks_per_second",n/alias_seconds);
+  json_member(out,first,"map_picks_per_second",n/map_seconds);
+  json_member(out,first,"speedup",map_seconds/alias_seconds);
+  json_member(out,first,"max_frequency_difference",max_frequency_difference);
+  out << "}";
+}
+
+//! Time generation of random stubs, as done for genesis and for mutation insert/substitute.
+void benchmark_stub(std::ostream& out,MutationParameters& mutation_parameters,uint n)
+{
+  Stopwatch stub_time;
+  for (uint i=0;i<n;i++)
+    {
+      mutation_parameters.random_function_stub(i&1);
+    }
+  const double stub_seconds=stub_time.seconds();
+
+  bool first=true;
+  out << "{";
+  json_member(out,first,"name",std::string("\"stub\""));
+  json_member(out,first,"stubs",n);
+  json_member(out,first,"stubs_per_second",n/stub_seconds);
+  out << "}";
+}
+
+//! Upper bounds (in nodes) of the tree size classes timed by the tree benchmark; each class starts above the one before.
+const uint tree_size_classes[]={16,64,256,1024,4096};
+
+//! Number of tree size classes.
+const uint tree_size_class_count=sizeof(tree_size_classes)/sizeof(tree_size_classes[0]);
+
+//! Trees timed in each size class.
+const uint trees_per_class=8;
+
+//! Number of nodes in an image's function tree.
+uint tree_nodes(const MutatableImage& image)
+{
+  uint nodes;
+  uint parameters;
+  uint depth;
+  uint width;
+  real proportion_constant;
+  image.get_stats(nodes,parameters,depth,width,proportion_constant);
+  return nodes;
+}
+
+//! Grow function trees from the seed, sorted into the tree size classes.
+/*! Trees are grown by repeatedly mutating random images with a high insertion probability (and no glitches),
+  taking at most one tree per size class from each lineage.
+ */
+void grow_trees(uint seed,std::vector<std::vector<boost::shared_ptr<const MutatableImage> > >& trees)
+{
+  MutationParameters growth(seed,false,false);
+  growth.base_probability_insert(0.3);
+  growth.base_probability_glitch(0.0);
+
+  trees.assign(tree_size_class_count,std::vector<boost::shared_ptr<const MutatableImage> >());
+
+  const uint max_mutations=100000;
+  boost::shared_ptr<const MutatableImage> image;
+  std::vector<bool> taken;
+  uint classes_filled=0;
+  for (uint i=0;i<max_mutations && classes_filled<tree_size_class_count;i++)
+    {
+      if (!image || tree_nodes(*image)>tree_size_classes[tree_size_class_count-1])
+	{
+	  std::auto_ptr<FunctionTop> fn_top(FunctionTop::initial(growth));
+	  image=boost::shared_ptr<const MutatableImage>(new MutatableImage(fn_top,true,false,false));
+	  taken.assign(tree_size_class_count,false);
+	}
+      else
+	{
+	  image=image->mutated(growth);
+	}
+
+      const uint nodes=tree_nodes(*image);
+      uint c=0;
+      while (c<tree_size_class_count && nodes>tree_size_classes[c]) c++;
+      if (c<tree_size_class_count && !taken[c] && trees[c].size()<trees_per_class)
+	{
+	  trees[c].push_back(image);
+	  taken[c]=true;
+	  if (trees[c].size()==trees_per_class) classes_filled++;
+	}
+    }
+}
+
+//! Time the operations on function trees which don't involve rendering, across classes of tree size.
+/*! Trees are from grow_trees.
+  Each operation is repeated enough to visit about n nodes in each class.
+  mutate and simplify time only the operation itself on a fresh (untimed) clone.
+ */
+void benchmark_tree(std::ostream& out,uint seed,uint n)
+{
+  std::vector<std::vector<boost::shared_ptr<const MutatableImage> > > trees;
+  grow_trees(seed,trees);
+
+  MutationParameters mutation(seed,false,false);
+
+  bool first=true;
+  out << "{";
+  json_member(out,first,"name",std::string("\"tree\""));
+  out << ",\"classes\":[";
+  for (uint c=0;c<tree_size_class_count;c++)
+    {
+      const std::vector<boost::shared_ptr<const MutatableImage> >& images=trees[c];
+      if (c) out << ",";
+      bool first_member=true;
+      out << "{";
+      json_member(out,first_member,"max_nodes",tree_size_classes[c]);
+      json_member(out,first_member,"trees",images.size());
+      if (images.empty())
+	{
+	  std::cerr << "evolvotron_benchmark: Warning: no trees of up to " << tree_size_classes[c] << " nodes grown\n";
+	  out << "}";
+	  continue;
+	}
+
+      uint nodes=0;
+      std::vector<std::string> xml;
+      for (uint i=0;i<images.size();i++)
+	{
+	  nodes+=tree_nodes(*images[i]);
+	  std::ostringstream s;
+	  images[i]->save_function(s);
+	  xml.push_back(s.str());
+	}
+      size_t xml_bytes=0;
+      for (uint i=0;i<xml.size();i++) xml_bytes+=xml[i].size();
+
+      const uint passes=std::max(1u,n/nodes);
+      const double visits=static_cast<double>(passes)*images.size();
+
+      // deepclone
+      double deepclone_seconds;
+      {
+	const Stopwatch stopwatch;
+	for (uint p=0;p<passes;p++)
+	  for (uint i=0;i<images.size();i++)
+	    images[i]->top().deepclone();
+	deepclone_seconds=stopwatch.seconds();
+      }
+
+      // mutate and simplify_constants, each on fresh clones
+      double mutate_seconds=0.0;
+      double simplify_seconds=0.0;
+      for (uint p=0;p<passes;p++)
+	{
+	  boost::ptr_vector<FunctionTop> mutants;
+	  boost::ptr_vector<FunctionTop> simplified;
+	  for (uint i=0;i<images.size();i++)
+	    {
+	      mutants.push_back(images[i]->top().typed_deepclone().release());
+	      simplified.push_back(images[i]->top().typed_deepclone().release());
+	    }
+	  {
+	    const Stopwatch stopwatch;
+	    for (uint i=0;i<mutants.size();i++)
+	      mutants[i].mutate(mutation);
+	    mutate_seconds+=stopwatch.seconds();
+	  }
+	  {
+	    const Stopwatch stopwatch;
+	    for (uint i=0;i<simplified.size();i++)
+	      simplified[i].simplify_constants();
+	    simplify_seconds+=stopwatch.seconds();
+	  }
+	}
+
+      // save_function
+      double save_seconds;
+      {
+	const Stopwatch stopwatch;
+	for (uint p=0;p<passes;p++)
+	  for (uint i=0;i<images.size();i++)
+	    {
+	      std::ostringstream s;
+	      images[i]->save_function(s);
+	    }
+	save_seconds=stopwatch.seconds();
+      }
+
+      // load_function
+      double load_seconds;
+      uint load_failures=0;
+      {
+	const Stopwatch stopwatch;
+	for (uint p=0;p<passes;p++)
+	  for (uint i=0;i<xml.size();i++)
+	    {
+	      std::istringstream s(xml[i]);
+	      std::string report;
+	      if (!MutatableImage::load_function(mutation.function_registry(),s,report)) load_failures++;
+	    }
+	load_seconds=stopwatch.seconds();
+      }
+      if (load_failures)
+	std::cerr << "evolvotron_benchmark: Warning: " << load_failures << " saved trees failed to load\n";
+
+      // get_stats
+      double stats_seconds;
+      uint stats_nodes=0;
+      {
+	const Stopwatch stopwatch;
+	for (uint p=0;p<passes;p++)
+	  for (uint i=0;i<images.size();i++)
+	    stats_nodes+=tree_nodes(*images[i]);
+	stats_seconds=stopwatch.seconds();
+      }
+      if (stats_nodes!=passes*nodes)
+	std::cerr << "evolvotron_benchmark: Warning: get_stats node counts changed\n";
+
+      json_member(out,first_member,"mean_nodes",static_cast<double>(nodes)/images.size());
+      json_member(out,first_member,"mean_xml_bytes",static_cast<double>(xml_bytes)/images.size());
+      json_member(out,first_member,"passes",passes);
+      json_member(out,first_member,"deepclone_microseconds",1e6*deepclone_seconds/visits);
+      json_member(out,first_member,"mutate_microseconds",1e6*mutate_seconds/visits);
+      json_member(out,first_member,"simplify_constants_microseconds",1e6*simplify_seconds/visits);
+      json_member(out,first_member,"save_function_microseconds",1e6*save_seconds/visits);
+      json_member(out,first_member,"load_function_microseconds",1e6*load_seconds/visits);
+      json_member(out,first_member,"get_stats_microseconds",1e6*stats_seconds/visits);
+      json_member(out,first_member,"load_failures",load_failures);
+      out << "}";
+    }
+  out << "]}";
+}
+
+//! Compare the cost model's estimates with the time actually taken to render each tree grown by grow_trees.
+/*! Reports, before and after calibrating the model, how well the estimates correlate with the measured times
+  (Pearson correlation of their logs; what matters for scheduling is the ordering and the ratios)
+  and the median and extremes of measured/estimated.
+ */
+void benchmark_cost(std::ostream& out,uint seed)
+{
+  std::vector<std::vector<boost::shared_ptr<const MutatableImage> > > trees;
+  grow_trees(seed,trees);
+  std::vector<boost::shared_ptr<const MutatableImage> > images;
+  for (uint c=0;c<trees.size();c++)
+    images.insert(images.end(),trees[c].begin(),trees[c].end());
+
+  std::vector<real> uncalibrated;
+  for (uint i=0;i<images.size();i++)
+    uncalibrated.push_back(FunctionCost::estimate(images[i]->top()));
+
+  const Stopwatch calibration_time;
+  FunctionCost::calibrate();
+  const double calibration_seconds=calibration_time.seconds();
+
+  std::vector<real> calibrated;
+  for (uint i=0;i<images.size();i++)
+    calibrated.push_back(FunctionCost::estimate(images[i]->top()));
+
+  // Render each tree small enough to keep the slowest to a fraction of a second
+  const uint size=32;
+  std::vector<real> measured;
+  for (uint i=0;i<images.size();i++)
+    {
+      const Stopwatch stopwatch;
+      for (uint y=0;y<size;y++)
+	for (uint x=0;x<size;x++)
+	  images[i]->get_rgb(x,y,0,size,size,1,0,1);
+      measured.push_back(stopwatch.seconds()/(size*size));
+    }
+
+  bool first=true;
+  out << "{";
+  json_member(out,first,"name",std::string("\"cost\""));
+  json_member(out,first,"trees",images.size());
+  json_member(out,first,"calibration_seconds",calibration_seconds);
+  for (uint e=0;e<2;e++)
+    {
+      const std::vector<real>& estimated=(e ? calibrated : uncalibrated);
+      const std::string prefix(e ? "calibrated_" : "uncalibrated_");
+
+      std::vector<real> ratios;
+      real sx=0.0,sy=0.0,sxx=0.0,syy=0.0,sxy=0.0;
+      for (uint i=0;i<images.size();i++)
+	{
+	  const real x=log(std::max(1e-12,estimated[i]));
+	  const real y=log(std::max(1e-12,measured[i]));
+	  sx+=x;sy+=y;sxx+=x*x;syy+=y*y;sxy+=x*y;
+	  ratios.push_back(measured[i]/std::max(1e-12,estimated[i]));
+	}
+      const real n=images.size();
+      const real covariance=sxy-sx*sy/n;
+      const real variance=(sxx-sx*sx/n)*(syy-sy*sy/n);
+      std::sort(ratios.begin(),ratios.end());
+
+      json_member(out,first,prefix+"log_correlation",(variance>0.0 ? covariance/sqrt(variance) : 0.0));
+      json_member(out,first,prefix+"ratio_min",(ratios.empty() ? 0.0 : ratios.front()));
+      json_member(out,first,prefix+"ratio_median",(ratios.empty() ? 0.0 : ratios[ratios.size()/2]));
+      json_member(out,first,prefix+"ratio_max",(ratios.empty() ? 0.0 : ratios.back()));
+    }
+  out << "}";
+}
+
+//! How long to wait for a grid to finish rendering before giving up on it.
+const double grid_timeout=300.0;
+
+//! Times (in seconds since an operation) at which a grid reached each rendering milestone.
+struct GridTimes
+{
+  //! Every display showing something (however coarse).
+  double preview;
+
+  //! Every display at full resolution.
+  double level0;
+
+  //! Every display at full resolution and multisampling.
+  double complete;
+};
+
+//! Pump the event loop until every display of main is finished, noting when each milestone is passed.
+/*! Times are from stopwatch, which should have been started just before the operation
+  (so its synchronous part, such as mutating and loading the displays, is included).
+  Returns false if the grid didn't finish within grid_timeout.
+ */
+bool wait_for_grid(EvolvotronMain& main,const Stopwatch& stopwatch,GridTimes& times)
+{
+  times.preview=times.level0=times.complete=-1.0;
+  while (true)
+    {
+      bool preview=true;
+      bool level0=true;
+      bool complete=true;
+      const std::vector<MutatableImageDisplay*>& displays=main.displays();
+      for (std::vector<MutatableImageDisplay*>::const_iterator it=displays.begin();it!=displays.end();it++)
+	{
+	  const uint level=(*it)->current_display_level();
+	  if (level==static_cast<uint>(-1)) preview=false;
+	  if (level!=0) level0=false;
+	  if (level!=0 || (*it)->current_display_multisample_grid()<main.render_parameters().multisample_grid()) complete=false;
+	}
+
+      const double t=stopwatch.seconds();
+      if (preview && times.preview<0.0) times.preview=t;
+      if (level0 && times.level0<0.0) times.level0=t;
+      if (complete)
+	{
+	  times.complete=t;
+	  return true;
+	}
+      if (t>grid_timeout) return false;
+
+      // Blocks until something happens; results are delivered by queued signals, and the main window's timer ticks regularly anyway
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+}
+
+//! Accumulates the timings of one kind of grid operation.
+class GridStats
+{
+ public:
+  GridStats(const std::string& name)
+    :_name(name)
+    ,_count(0)
+    ,_timeouts(0)
+    {
+      for (uint i=0;i<3;i++) _total[i]=_max[i]=0.0;
+    }
+
+  //! Time an operation on main, stopwatch having been started just before it.
+  void wait(EvolvotronMain& main,const Stopwatch& stopwatch)
+    {
+      GridTimes times;
+      if (!wait_for_grid(main,stopwatch,times))
+	{
+	  std::cerr << "evolvotron_benchmark: Warning: " << _name << " didn't complete within " << grid_timeout << "s\n";
+	  _timeouts++;
+	  return;
+	}
+      std::clog << _name << ": " << times.preview << "s to preview, " << times.level0 << "s to level 0, " << times.complete << "s to complete\n";
+      const double t[3]={times.preview,times.level0,times.complete};
+      for (uint i=0;i<3;i++)
+	{
+	  _total[i]+=t[i];
+	  _max[i]=std::max(_max[i],t[i]);
+	}
+      _count++;
+    }
+
+  //! Write as a JSON object.
+  void write(std::ostream& out) const
+    {
+      static const char*const names[3]={"preview","level0","complete"};
+      bool first=true;
+      out << "{";
+      json_member(out,first,"operation","\""+_name+"\"");
+      json_member(out,first,"count",_count);
+      json_member(out,first,"timeouts",_timeouts);
+      for (uint i=0;i<3;i++)
+	{
+	  json_member(out,first,std::string(names[i])+"_mean_seconds",(_count ? _total[i]/_count : 0.0));
+	  json_member(out,first,std::string(names[i])+"_max_seconds",_max[i]);
+	}
+      out << "}";
+    }
+
+ private:
+  const std::string _name;
+  uint _count;
+  uint _timeouts;
+  double _total[3];
+  double _max[3];
+};
+
+//! Drive the whole application through reset, spawn, warp and undo cycles on a grid, timing how long the grid takes to render.
+/*! The seed fixes the image functions (although which tasks finish first, and so the order of any
+  probe replacements, depends on thread scheduling).
+  Needs a display: run under Xvfb (e.g xvfb-run) on a headless machine.
+ */
+void benchmark_grid(std::ostream& out,uint cols,uint rows,uint seed,uint cycles,uint threads,uint multisample)
+{
+  EvolvotronMain*const main=new EvolvotronMain
+    (
+     0,
+     QSize(cols,rows),
+     1,
+     8,
+     threads,
+     4,
+     false,
+     false,
+     false,
+     false,
+     multisample,
+     false,
+     false,
+     false,
+     std::vector<std::string>(),
+     false,
+     seed
+     );
+  main->resize(1024,768);
+  main->show();
+
+  GridStats reset_stats("reset");
+  GridStats spawn_stats("spawn");
+  GridStats warp_stats("warp");
+  GridStats undo_stats("undo");
+
+  // Let the window get its size before the grid is rendered at it
+  QCoreApplication::processEvents();
+  {
+    const Stopwatch stopwatch;
+    main->reset_cold();
+    reset_stats.wait(*main,stopwatch);
+  }
+
+  // Timed from the "click", so including the mutating and queueing done before the call returns
+  for (uint i=0;i<cycles;i++)
+    {
+      {
+	const Stopwatch stopwatch;
+	main->spawn_normal(main->displays()[0]);
+	spawn_stats.wait(*main,stopwatch);
+      }
+      {
+	const Stopwatch stopwatch;
+	main->spawn_warped(main->displays()[0],TransformFactoryRandomWarpXY());
+	warp_stats.wait(*main,stopwatch);
+      }
+      {
+	const Stopwatch stopwatch;
+	main->history().undo();
+	undo_stats.wait(*main,stopwatch);
+      }
+    }
+
+  std::ostringstream name;
+  name << "\"grid " << cols << "x" << rows << "\"";
+  bool first=true;
+  out << "{";
+  json_member(out,first,"name",name.str());
+  json_member(out,first,"cycles",cycles);
+  json_member(out,first,"threads",threads);
+  json_member(out,first,"multisample",multisample);
+  json_member(out,first,"width",main->displays()[0]->image_size().width());
+  json_member(out,first,"height",main->displays()[0]->image_size().height());
+  out << ",\"operations\":[";
+  reset_stats.write(out);
+  out << ",";
+  spawn_stats.write(out);
+  out << ",";
+  warp_stats.write(out);
+  out << ",";
+  undo_stats.write(out);
+  out << "]}";
+
+  delete main;
+}
+
+//! Application code
+int main(int argc,char* argv[])
+{
+  {
+    std::vector<std::string> benchmarks;
+    uint cycles;
+    bool help;
+    uint multisample;
+    uint repetitions;
+    uint seed;
+    uint threads;
+    bool verbose;
+
+    boost::program_options::options_description options_desc("Options");
+    boost::program_options::positional_options_description pos_options_desc;
+    {
+      using namespace boost::program_options;
+      options_desc.add_options()
+	("benchmark,b"  ,value<std::vector<std::string> >(&benchmarks),"Benchmark(s) to run: pick, stub, tree, cost, grid (default pick, stub and tree).  (Or use positional arguments.)")
+	("cycles,c"     ,value<uint>(&cycles)->default_value(3)        ,"Spawn, warp and undo cycles for the grid benchmark")
+	("help,h"       ,bool_switch(&help)                            ,"Print command-line options help message and exit")
+	("multisample,m",value<uint>(&multisample)->default_value(2)   ,"Multisampling grid for the grid benchmark")
+	("repetitions,n",value<uint>(&repetitions)->default_value(1000000),"Repetitions of the benchmarked operation")
+	("seed,s"       ,value<uint>(&seed)->default_value(23)         ,"Random number seed")
+	("threads,t"    ,value<uint>(&threads)->default_value(get_number_of_processors()),"Compute threads for the grid benchmark")
+	("verbose,v"    ,bool_switch(&verbose)                         ,"Log some details to stderr")
+	;
+      pos_options_desc.add("benchmark",-1);
+    }
+
+    boost::program_options::variables_map options;
+    boost::program_options::store
+      (
+       boost::program_options::command_line_parser(argc,argv)
+       .options(options_desc).positional(pos_options_desc).run()
+       ,options
+       );
+    boost::program_options::notify(options);
+    
+    if (help)
+      {
+	std::cerr << options_desc;
+	return 0;
+      }
+
+    if (verbose)
+      std::clog.rdbuf(std::cerr.rdbuf());
+    else
+      std::clog.rdbuf(sink_ostream.rdbuf());
+
+    if (repetitions<1)
+      {
+	std::cerr << "Must specify at least 1 repetition (option: -n <repetitions>)\n";
+	return 1;
+      }
+
+    if (threads<1)
+      {
+	std::cerr << "Must specify at least 1 compute thread (option: -t <threads>)\n";
+	return 1;
+      }
+
+    if (multisample<1 || multisample>4)
+      {
+	std::cerr << "Multisample grid must be 1-4 (option: -m <multisample>)\n";
+	return 1;
+      }
+
+    if (benchmarks.empty())
+      {
+	benchmarks.push_back("pick");
+	benchmarks.push_back("stub");
+	benchmarks.push_back("tree");
+      }
+
+    // Check them all before writing anything, so a bad name can't leave truncated output.
+    const char*const known_benchmarks[]={"pick","stub","tree","cost","grid"};
+    const char*const*const known_benchmarks_end=known_benchmarks+sizeof(known_benchmarks)/sizeof(known_benchmarks[0]);
+    for (std::vector<std::string>::const_iterator it=benchmarks.begin();it!=benchmarks.end();it++)
+      if (std::find(known_benchmarks,known_benchmarks_end,*it)==known_benchmarks_end)
+	{
+	  std::cerr << "evolvotron_benchmark: Error: Unknown benchmark " << *it << "\n";
+	  return 1;
+	}
+
+    // The grid benchmark needs the whole GUI application
+    std::auto_ptr<QApplication> app;
+    if (std::find(benchmarks.begin(),benchmarks.end(),"grid")!=benchmarks.end())
+      app.reset(new QApplication(argc,argv));
+
+    MutationParameters mutation_parameters(seed,false,false);
+
+    bool first=true;
+    std::cout << "{";
+    json_member(std::cout,first,"seed",seed);
+    json_member(std::cout,first,"repetitions",repetitions);
+    std::cout << ",\"benchmarks\":[";
+    for (std::vector<std::string>::const_iterator it=benchmarks.begin();it!=benchmarks.end();it++)
+      {
+	std::clog << "Running benchmark " << *it << "\n";
+
+	if (it!=benchmarks.begin()) std::cout << ",";
+
+	if (*it=="pick")
+	  {
+	    benchmark_pick(std::cout,mutation_parameters,seed,repetitions);
+	  }
+	else if (*it=="stub")
+	  {
+	    benchmark_stub(std::cout,mutation_parameters,repetitions);
+	  }
+	else if (*it=="tree")
+	  {
+	    benchmark_tree(std::cout,seed,repetitions);
+	  }
+	else if (*it=="cost")
+	  {
+	    benchmark_cost(std::cout,seed);
+	  }
+	else
+	  {
+	    assert(*it=="grid");
+	    benchmark_grid(std::cout,6,5,seed,cycles,threads,multisample);
+	    std::cout << ",";
+	    benchmark_grid(std::cout,12,10,seed,cycles,threads,multisample);
+	  }
+      }
+    std::cout << "]}\n";
+  }
+
+#ifndef NDEBUG
+    assert(InstanceCounted::is_clear());
+#endif
+    
+  return 0;
+}
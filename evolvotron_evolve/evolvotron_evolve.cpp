@@ -0,0 +1,348 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Standalone unattended evolver for evolvotron function trees.
+  Each generation the best few candidates are mutated to make a large population,
+  which is rendered as small thumbnails in parallel and scored by image metrics.
+*/
+
+#include "evolvotron_evolve_precompiled.h"
+
+#include "function_top.h"
+#include "image_metric.h"
+#include "mutatable_image.h"
+#include "mutation_parameters.h"
+#include "platform_specific.h"
+
+//! Thread rendering and scoring thumbnails of candidates.
+/*! Rather than queuing a task per candidate, all threads claim the next unscored candidate
+  from a shared atomic counter, and reuse the same thumbnail image for every candidate they render.
+ */
+class ThumbnailScorer : public QThread
+{
+ public:
+  ThumbnailScorer
+  (
+   const std::vector<boost::shared_ptr<const MutatableImage> >& candidates,
+   std::vector<real>& scores,
+   QAtomicInt& next,
+   const ImageScore& score,
+   const QSize& size
+   )
+    :_candidates(candidates)
+    ,_scores(scores)
+    ,_next(next)
+    ,_score(score)
+    ,_size(size)
+    {}
+
+ protected:
+  virtual void run()
+    {
+      QImage image(_size,QImage::Format_RGB32);
+      
+      int i;
+      while ((i=_next.fetchAndAddOrdered(1))<static_cast<int>(_candidates.size()))
+	{
+	  const MutatableImage& candidate=*_candidates[i];
+	  for (int row=0;row<_size.height();row++)
+	    {
+	      QRgb*const line=reinterpret_cast<QRgb*>(image.scanLine(row));
+	      for (int col=0;col<_size.width();col++)
+		{
+		  const XYZ colour(candidate.get_rgb(col,row,0,_size.width(),_size.height(),1,0,1));
+		  // Clamp, or out of range channels wrap and make spurious edges and entropy.
+		  line[col]=qRgb(lrint(clamped(colour.x(),0.0,255.0)),lrint(clamped(colour.y(),0.0,255.0)),lrint(clamped(colour.z(),0.0,255.0)));
+		}
+	    }
+	  _scores[i]=_score(image);
+	}
+    }
+
+ private:
+  const std::vector<boost::shared_ptr<const MutatableImage> >& _candidates;
+  std::vector<real>& _scores;
+  QAtomicInt& _next;
+  const ImageScore _score;
+  const QSize _size;
+};
+
+//! Order candidate indices by descending score.
+class ByScoreDescending
+{
+ public:
+  ByScoreDescending(const std::vector<real>& scores)
+    :_scores(scores)
+    {}
+  bool operator()(uint a,uint b) const
+    {
+      return _scores[a]>_scores[b];
+    }
+ private:
+  const std::vector<real>& _scores;
+};
+
+//! Application code
+int main(int argc,char* argv[])
+{
+  {
+    uint generations;
+    bool help;
+    uint keep;
+    bool linear;
+    std::vector<std::string> metrics;
+    std::string output_prefix;
+    uint population;
+    uint seed;
+    std::string size;
+    bool spheremap;
+    uint threads;
+    bool verbose;
+    std::vector<std::string> input_filenames;
+
+    boost::program_options::options_description options_desc("Options");
+    boost::program_options::positional_options_description pos_options_desc;
+    {
+      using namespace boost::program_options;
+      options_desc.add_options()
+	("generations,g",value<uint>(&generations)->default_value(10)      ,"Number of generations")
+	("help,h"       ,bool_switch(&help)                                ,"Print command-line options help message and exit")
+	("keep,k"       ,value<uint>(&keep)->default_value(8)              ,"Number of best candidates kept as parents of the next generation, and saved at the end")
+	("linear,l"     ,bool_switch(&linear)                              ,"Sweep z linearly in animations")
+	("metric,m"     ,value<std::vector<std::string> >(&metrics)        ,"Scoring metric as name or name=weight; may be repeated.  Metrics: entropy, edges, variance, coherence (default all, equally weighted)")
+	("output,o"     ,value<std::string>(&output_prefix)->default_value("evolved"),"Prefix for saved function filenames")
+	("population,p" ,value<uint>(&population)->default_value(1000)     ,"Candidates rendered and scored per generation")
+	("seed"         ,value<uint>(&seed)                                ,"Random number seed (default from time and process id)")
+	("size,s"       ,value<std::string>(&size)->default_value("32x32") ,"Thumbnail size used for scoring")
+	("spheremap"    ,bool_switch(&spheremap)                           ,"Generate spheremaps")
+	("threads,t"    ,value<uint>(&threads)->default_value(get_number_of_processors()),"Number of rendering threads")
+	("verbose,v"    ,bool_switch(&verbose)                             ,"Log some details to stderr")
+	("input"        ,value<std::vector<std::string> >(&input_filenames),"Function file(s) to start from (otherwise start from random functions)")
+	;
+      pos_options_desc.add("input",-1);
+    }
+
+    boost::program_options::variables_map options;
+    boost::program_options::store
+      (
+       boost::program_options::command_line_parser(argc,argv)
+       .options(options_desc).positional(pos_options_desc).run()
+       ,options
+       );
+    boost::program_options::notify(options);
+
+    if (help)
+      {
+	std::cerr << options_desc;
+	return 0;
+      }
+
+    if (verbose)
+      std::clog.rdbuf(std::cerr.rdbuf());
+    else
+      std::clog.rdbuf(sink_ostream.rdbuf());
+
+    //! \todo Could be done better maybe (set 'x' as input separator)
+    const std::string::size_type p=size.find("x");
+    if (p==std::string::npos || p==0 || p==size.size()-1)
+      {
+	std::cerr << "--size option argument isn't in <width>x<height> format\n";
+	return 1;
+      }
+    else
+      {
+	size[p]=' ';
+      }
+    int width=32;
+    int height=32;
+    std::stringstream(size) >> width >> height;
+    
+    if (width<2 || height<2)
+      {
+	std::cerr << "Thumbnail size must be at least 2x2\n";
+	return 1;
+      }
+
+    if (keep<1 || population<keep)
+      {
+	std::cerr << "Must keep at least 1 candidate, and no more than the population\n";
+	return 1;
+      }
+
+    if (threads<1)
+      {
+	std::cerr << "Must use at least 1 thread\n";
+	return 1;
+      }
+
+    ImageScore score;
+    if (metrics.empty())
+      {
+	const std::vector<std::string> names(ImageMetric::names());
+	for (std::vector<std::string>::const_iterator it=names.begin();it!=names.end();it++)
+	  score.add(ImageMetric::create(*it),1.0);
+      }
+    for (std::vector<std::string>::const_iterator it=metrics.begin();it!=metrics.end();it++)
+      {
+	const std::string::size_type e=it->find("=");
+	const std::string name=it->substr(0,e);
+	real weight=1.0;
+	if (e!=std::string::npos)
+	  std::stringstream(it->substr(e+1)) >> weight;
+	std::auto_ptr<ImageMetric> metric(ImageMetric::create(name));
+	if (!metric.get())
+	  {
+	    std::cerr << "evolvotron_evolve: Error: Unknown metric " << name << "\n";
+	    return 1;
+	  }
+	score.add(metric,weight);
+      }
+
+    if (!options.count("seed"))
+      {
+	// As evolvotron_mutate: several of these might start up at once.
+	QTime t(QTime::currentTime());
+	seed=getpid()+t.msec()+1000*t.second()+60000*t.minute()+3600000*t.hour();
+      }
+    std::clog << "Random seed is " << seed << "\n";
+
+    MutationParameters mutation_parameters(seed,false,false);
+
+    std::vector<boost::shared_ptr<const MutatableImage> > parents;
+    for (std::vector<std::string>::const_iterator it=input_filenames.begin();it!=input_filenames.end();it++)
+      {
+	std::ifstream file(it->c_str());
+	std::string report;
+	const boost::shared_ptr<const MutatableImage> imagefn
+	  (
+	   MutatableImage::load_function(mutation_parameters.function_registry(),file,report)
+	   );
+	if (imagefn.get()==0)
+	  {
+	    std::cerr << "evolvotron_evolve: Error: Function " << *it << " not loaded due to errors:\n" << report;
+	    return 1;
+	  }
+	else if (!report.empty())
+	  {
+	    std::cerr << "evolvotron_evolve: Warning: Function " << *it << " loaded with warnings:\n" << report;
+	  }
+	parents.push_back(imagefn);
+      }
+
+    std::clog << "Scoring with ";
+    score.describe(std::clog) << "\n";
+
+    std::vector<boost::shared_ptr<const MutatableImage> > candidates;
+    std::vector<real> scores;
+    std::vector<uint> ranking;
+
+    QElapsedTimer total_time;
+    total_time.start();
+    uint total_candidates=0;
+
+    for (uint generation=0;generation<generations;generation++)
+      {
+	// Parents survive unchanged; the rest of the population are their mutants (or new random images).
+	candidates=parents;
+	for (uint i=candidates.size();i<population;i++)
+	  {
+	    boost::shared_ptr<const MutatableImage> candidate;
+	    do
+	      {
+		if (parents.empty())
+		  {
+		    std::auto_ptr<FunctionTop> fn_top(FunctionTop::initial(mutation_parameters));
+		    candidate=boost::shared_ptr<const MutatableImage>(new MutatableImage(fn_top,!linear,spheremap,false));
+		  }
+		else
+		  {
+		    candidate=parents[i%parents.size()]->mutated(mutation_parameters);
+		  }
+	      }
+	    while (candidate->is_constant());
+	    candidates.push_back(candidate);
+	  }
+
+	QElapsedTimer generation_time;
+	generation_time.start();
+
+	scores.assign(candidates.size(),0.0);
+	QAtomicInt next(0);
+	boost::ptr_vector<ThumbnailScorer> scorers;
+	for (uint t=0;t<threads;t++)
+	  {
+	    scorers.push_back(new ThumbnailScorer(candidates,scores,next,score,QSize(width,height)));
+	    scorers.back().start();
+	  }
+	for (uint t=0;t<threads;t++)
+	  scorers[t].wait();
+
+	const double seconds=std::max(1e-9,1e-9*generation_time.nsecsElapsed());
+	total_candidates+=candidates.size();
+
+	ranking.resize(candidates.size());
+	for (uint i=0;i<ranking.size();i++) ranking[i]=i;
+	std::stable_sort(ranking.begin(),ranking.end(),ByScoreDescending(scores));
+
+	parents.clear();
+	for (uint i=0;i<keep;i++)
+	  parents.push_back(candidates[ranking[i]]);
+
+	real mean=0.0;
+	for (uint i=0;i<scores.size();i++) mean+=scores[i];
+	mean/=scores.size();
+
+	std::cout
+	  << "Generation " << generation
+	  << ": " << candidates.size() << " candidates"
+	  << ", best " << scores[ranking[0]]
+	  << ", mean " << mean
+	  << ", " << candidates.size()/seconds << " candidates/s\n";
+
+	mutation_parameters.autocool_generations_increment();
+      }
+
+    std::cout << "Overall: " << total_candidates/std::max(1e-9,1e-9*total_time.nsecsElapsed()) << " candidates/s\n";
+
+    for (uint i=0;i<parents.size();i++)
+      {
+	std::ostringstream filename;
+	filename << output_prefix << std::setfill('0') << std::setw(3) << i << ".xml";
+	std::ofstream file(filename.str().c_str());
+	parents[i]->save_function(file);
+	file.flush();
+	if (!file)
+	  {
+	    std::cerr << "evolvotron_evolve: Error: Couldn't write " << filename.str() << "\n";
+	    return 1;
+	  }
+	std::clog << "Saved " << filename.str() << "\n";
+      }
+
+    candidates.clear();
+    parents.clear();
+  }
+
+#ifndef NDEBUG
+    assert(InstanceCounted::is_clear());
+#endif
+    
+  return 0;
+}
@@ -23,7 +23,9 @@
 
 #include "evolvotron_render_precompiled.h"
 
+#include "function_compiler.h"
 #include "function_registry.h"
+#include "function_top.h"
 #include "mutatable_image.h"
 #include "random.h"
 
@@ -32,10 +34,14 @@ int main(int argc,char* argv[])
 {
   {
     uint frames;
+    std::string heatmap_name;
     bool help;
+    bool jit;
+    std::string jit_cache;
     bool jitter;
     int multisample;
     std::string output_filename;
+    bool profile;
     std::string size;
     bool verbose;
     
@@ -45,10 +51,14 @@ int main(int argc,char* argv[])
       using namespace boost::program_options;
       options_desc.add_options()
 	("frames,f"     ,value<uint>(&frames)->default_value(1)    ,"Frames in an animation")
+	("heatmap"      ,value<std::string>(&heatmap_name)         ,"Render a heatmap of the cost of each pixel instead: 'evaluations' (function nodes evaluated) or 'time'")
 	("help,h"       ,bool_switch(&help)                        ,"Print command-line options help message and exit")
+	("jit"          ,bool_switch(&jit)                         ,"Compile the function to native code before rendering (needs a C++ compiler; falls back to the interpreter)")
+	("jit-cache"    ,value<std::string>(&jit_cache)            ,"Directory for compiled functions (default ~/.cache/evolvotron)")
 	("jitter,j"     ,bool_switch(&jitter)                      ,"Enable rendering jitter")
 	("multisample,m",value<int>(&multisample)->default_value(1),"Multisampling grid (NxN)")
 	("output,o"     ,value<std::string>(&output_filename)      ,"Output filename (.png or .ppm suffix).  (Or use first positional argument.)")
+	("profile"      ,bool_switch(&profile)                     ,"Print a table of evaluations and time per function class and node to stdout")
 	("size,s"       ,value<std::string>(&size)->default_value("512x515"),"Generated image size")
 	("verbose,v"    ,bool_switch(&verbose)                     ,"Log some details to stderr")
 	;
@@ -101,11 +111,22 @@ int main(int argc,char* argv[])
 	std::cerr << "Must specify an output filename\n";
 	return 1;
       }
+
+    MutatableImage::Heatmap heatmap=MutatableImage::HeatmapNone;
+    if (heatmap_name=="evaluations")
+      heatmap=MutatableImage::HeatmapEvaluations;
+    else if (heatmap_name=="time")
+      heatmap=MutatableImage::HeatmapTime;
+    else if (!heatmap_name.empty())
+      {
+	std::cerr << "--heatmap option argument must be 'evaluations' or 'time'\n";
+	return 1;
+      }
     
     FunctionRegistry function_registry;
     
     std::string report;
-    const boost::shared_ptr<const MutatableImage> imagefn(MutatableImage::load_function(function_registry,std::cin,report));
+    boost::shared_ptr<const MutatableImage> imagefn(MutatableImage::load_function(function_registry,std::cin,report));
 
     if (imagefn.get()==0)
       {
@@ -117,13 +138,34 @@ int main(int argc,char* argv[])
 	std::cerr << "evolvotron_render: Warning: Function loaded with warnings:\n" << report;
       }
 
+    if (jit && (profile || heatmap==MutatableImage::HeatmapEvaluations))
+      {
+	std::cerr << "evolvotron_render: Warning: Compiled functions can't be profiled; interpreting it instead\n";
+	jit=false;
+      }
+
+    if (jit)
+      {
+	const FunctionCompiler compiler(std::clog,"",jit_cache);
+	const boost::shared_ptr<const MutatableImage> compiled(imagefn->compiled(compiler));
+	if (compiled)
+	  imagefn=compiled;
+	else
+	  std::cerr << "evolvotron_render: Warning: Function couldn't be compiled (use -v for details); interpreting it instead\n";
+      }
+
+    FunctionProfile::enable(profile);
+    FunctionProfile::count(heatmap==MutatableImage::HeatmapEvaluations);
+
     // Seed value pretty unimportant; only used for sample jitter.
-    Random01 r01(23);
+    // Same seed as the GUI's compute threads so jittered renders match.
+    const RandomCounter01 jitter_generator(23);
 
     for (uint frame=0;frame<frames;frame++)
       {
 	std::vector<uint> image_data;
 	image_data.reserve(width*height);
+	const MemoryAccount::Charge image_memory(MemoryAccount::RenderBuffers,width*height*sizeof(uint));
   
 	uint pixels=0;
 	uint report=1;
@@ -133,7 +175,14 @@ int main(int argc,char* argv[])
 	    {
 	      const XYZ v(imagefn->sampling_coordinate(col,row,frame,width,height,frames));
 	    
-	      const XYZ colour(imagefn->get_rgb(col,row,frame,width,height,frames,(jitter ? &r01 : 0),multisample));
+	      const XYZ colour
+		(
+		 heatmap==MutatableImage::HeatmapNone
+		 ?
+		 imagefn->get_rgb(col,row,frame,width,height,frames,(jitter ? &jitter_generator : 0),multisample)
+		 :
+		 imagefn->get_heatmap_rgb(col,row,frame,width,height,frames,(jitter ? &jitter_generator : 0),multisample,heatmap)
+		 );
 	    
 	      const uint col0=lrint(clamped(colour.x(),0.0,255.0));
 	      const uint col1=lrint(clamped(colour.y(),0.0,255.0));
@@ -209,6 +258,12 @@ int main(int argc,char* argv[])
 	    << "\n";
 	}
       }
+
+    if (profile)
+      FunctionProfile::report(std::cout,imagefn->top());
+
+    // Only seen with -v.
+    MemoryAccount::report(std::clog);
   }
 
 #ifndef NDEBUG
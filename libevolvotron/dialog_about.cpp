@@ -27,7 +27,7 @@
 
 #include "license.h"
 
-DialogAbout::DialogAbout(QWidget* parent,int n_threads,bool separate_farm_for_enlargements)
+DialogAbout::DialogAbout(QWidget* parent,int n_threads)
   :QDialog(parent)
 {
   assert(parent!=0);
@@ -55,8 +55,6 @@ DialogAbout::DialogAbout(QWidget* parent,int n_threads,bool separate_farm_for_en
     << stringify(EVOLVOTRON_BUILD)
     << "\n\n"
     << "Using "
-    << (separate_farm_for_enlargements ? "2 pools" : "1 pool")
-    << " of "
     << n_threads
     << " compute thread"
     << (n_threads>1 ? "s" : "")
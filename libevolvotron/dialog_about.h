@@ -35,7 +35,7 @@ class DialogAbout : public QDialog
  public:
 
   //! Constructor.
-  DialogAbout(QWidget* parent,int n_threads,bool separate_farm_for_enlargements);
+  DialogAbout(QWidget* parent,int n_threads);
 
   //! Destructor.
   ~DialogAbout();
@@ -0,0 +1,84 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class DialogFarmStats.
+*/
+
+#include "libevolvotron_precompiled.h"
+
+#include "dialog_farm_stats.h"
+
+DialogFarmStats::DialogFarmStats(QMainWindow* parent,const MutatableImageComputerFarm& farm)
+  :QDialog(parent)
+  ,_farm(farm)
+{
+  setWindowTitle("Compute Statistics");
+  setSizeGripEnabled(true);
+
+  setLayout(new QVBoxLayout);
+
+  _textedit=new QTextEdit;
+  _textedit->setReadOnly(true);
+  _textedit->setLineWrapMode(QTextEdit::NoWrap);
+  _textedit->setFontFamily("Courier");
+  _textedit->setMinimumSize(480,320);
+  layout()->addWidget(_textedit);
+
+  _ok=new QPushButton("OK");
+  _ok->setDefault(true);
+  layout()->addWidget(_ok);
+
+  connect(
+	  _ok,SIGNAL(clicked()),
+	  this,SLOT(hide())
+	  );
+
+  _timer=new QTimer(this);
+  connect(
+	  _timer,SIGNAL(timeout()),
+	  this,SLOT(update_stats())
+	  );
+}
+
+DialogFarmStats::~DialogFarmStats()
+{}
+
+void DialogFarmStats::showEvent(QShowEvent* event)
+{
+  _stats=_farm.stats();
+  _textedit->setPlainText("Collecting...");
+  _timer->start(1000);
+  QDialog::showEvent(event);
+}
+
+void DialogFarmStats::hideEvent(QHideEvent* event)
+{
+  _timer->stop();
+  QDialog::hideEvent(event);
+}
+
+void DialogFarmStats::update_stats()
+{
+  const MutatableImageComputerFarm::Stats stats(_farm.stats());
+  std::ostringstream report;
+  MutatableImageComputerFarm::report(report,_stats,stats);
+  _textedit->setPlainText(report.str().c_str());
+  _stats=stats;
+}
@@ -0,0 +1,69 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file 
+  \brief Interface for class DialogFarmStats.
+*/
+
+#ifndef _dialog_farm_stats_h_
+#define _dialog_farm_stats_h_
+
+#include "mutatable_image_computer_farm.h"
+
+//! Provides a dialog box showing how busy the compute farm is, updated every second while shown.
+class DialogFarmStats : public QDialog
+{
+ private:
+  Q_OBJECT
+
+ protected:
+  //! The farm reported on.
+  const MutatableImageComputerFarm& _farm;
+
+  //! Snapshot of the farm's counters at the last update; rates are over the time since.
+  MutatableImageComputerFarm::Stats _stats;
+
+  //! Shows the report.
+  QTextEdit* _textedit;
+
+  //! Triggers updates.
+  QTimer* _timer;
+
+  //! Button to close dialog.
+  QPushButton* _ok;
+
+  //! Start updating (from a fresh snapshot).
+  void showEvent(QShowEvent*);
+
+  //! Stop updating.
+  void hideEvent(QHideEvent*);
+
+ public:
+  //! Constructor.
+  DialogFarmStats(QMainWindow* parent,const MutatableImageComputerFarm& farm);
+
+  //! Destructor.
+  ~DialogFarmStats();
+
+ public slots:
+  //! Signalled by timer.
+  void update_stats();
+};
+
+#endif
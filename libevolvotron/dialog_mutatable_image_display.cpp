@@ -43,6 +43,12 @@ DialogMutatableImageDisplay::DialogMutatableImageDisplay(QWidget* parent)
   _textedit_xml->setReadOnly(true);
   _tabs->addTab(_textedit_xml,"Detail");
 
+  _textedit_profile=new QTextEdit;
+  _textedit_profile->setReadOnly(true);
+  _textedit_profile->setLineWrapMode(QTextEdit::NoWrap);
+  _textedit_profile->setFontFamily("Courier");
+  _tabs->addTab(_textedit_profile,"Profile");
+
   _ok=new QPushButton("OK");
   _ok->setDefault(true);
   layout()->addWidget(_ok);
@@ -56,13 +62,15 @@ DialogMutatableImageDisplay::DialogMutatableImageDisplay(QWidget* parent)
 DialogMutatableImageDisplay::~DialogMutatableImageDisplay()
 {}
 
-void DialogMutatableImageDisplay::set_content(const std::string& m,const std::string& x)
+void DialogMutatableImageDisplay::set_content(const std::string& m,const std::string& x,const std::string& p)
 {
   _label_info->setText(QString(m.c_str()));
   _label_info->adjustSize();
 
   _textedit_xml->setPlainText(x.c_str());
 
+  _textedit_profile->setPlainText(p.c_str());
+
   adjustSize();
   updateGeometry();
 }
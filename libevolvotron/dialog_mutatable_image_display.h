@@ -45,6 +45,9 @@ class DialogMutatableImageDisplay : public QDialog
   //! Scrolling text area for XML description.
   QTextEdit* _textedit_xml;
 
+  //! Scrolling text area for function evaluation profile.
+  QTextEdit* _textedit_profile;
+
   //! Button to close dialog.
   QPushButton* _ok;
 
@@ -55,8 +58,8 @@ class DialogMutatableImageDisplay : public QDialog
   //! Destructor.
   ~DialogMutatableImageDisplay();
 
-  //! Set content of main text and scrolling area.
-  void set_content(const std::string& m,const std::string& x);
+  //! Set content of main text and scrolling areas.
+  void set_content(const std::string& m,const std::string& x,const std::string& p);
 };
 
 #endif
@@ -139,6 +139,48 @@ DialogMutationParameters::DialogMutationParameters(QMainWindow* parent,MutationP
   grid_autocool_layout->addWidget(_button_autocool_reheat=new QPushButton("Reheat"),2,1);
   connect(_button_autocool_reheat,SIGNAL(clicked()),this,SLOT(reheat()));
 
+  _vbox_probe=new QWidget;
+  _vbox_probe->setLayout(new QVBoxLayout);
+  _tabs->addTab(_vbox_probe,"Probe");
+
+  _grid_probe=new QWidget;
+  _vbox_probe->layout()->addWidget(_grid_probe);
+  QGridLayout*const grid_probe_layout=new QGridLayout();
+  _grid_probe->setLayout(grid_probe_layout);
+
+  grid_probe_layout->addWidget(new QLabel("Probe threshold"),0,0);
+  grid_probe_layout->addWidget(_spinbox_probe_threshold=new QSpinBox,0,1);
+  _spinbox_probe_threshold->setRange(0,_scale);
+  _spinbox_probe_threshold->setSingleStep(maximum(1,_scale/100));
+  _spinbox_probe_threshold->setSuffix(QString("/%1").arg(_scale));
+  _spinbox_probe_threshold->setSpecialValueText("Off");
+  _spinbox_probe_threshold->setToolTip("New images are first rendered at 16x16 and scored on colour variation and edges; those scoring below this are replaced before being fully rendered.");
+
+  _vbox_cost=new QWidget;
+  _vbox_cost->setLayout(new QVBoxLayout);
+  _tabs->addTab(_vbox_cost,"Cost");
+
+  _grid_cost=new QWidget;
+  _vbox_cost->layout()->addWidget(_grid_cost);
+  QGridLayout*const grid_cost_layout=new QGridLayout();
+  _grid_cost->setLayout(grid_cost_layout);
+
+  grid_cost_layout->addWidget(new QLabel("Cost budget"),0,0);
+  grid_cost_layout->addWidget(_spinbox_cost_budget=new QSpinBox,0,1);
+  _spinbox_cost_budget->setRange(0,100000);
+  _spinbox_cost_budget->setSingleStep(10);
+  _spinbox_cost_budget->setSuffix("us/sample");
+  _spinbox_cost_budget->setSpecialValueText("Off");
+  _spinbox_cost_budget->setToolTip("Mutants estimated to take longer than this (in microseconds per sample) to render are replaced by other mutants, or failing that have their iteration counts cut.");
+
+  grid_cost_layout->addWidget(new QLabel("Parsimony"),1,0);
+  grid_cost_layout->addWidget(_spinbox_parsimony=new QSpinBox,1,1);
+  _spinbox_parsimony->setRange(0,_scale);
+  _spinbox_parsimony->setSingleStep(maximum(1,_scale/100));
+  _spinbox_parsimony->setSuffix(QString("/%1").arg(_scale));
+  _spinbox_parsimony->setSpecialValueText("Off");
+  _spinbox_parsimony->setToolTip("Probability of making two mutants and keeping the one estimated to be cheaper to render.  When on, parts of mutants which are constant are also simplified to a single constant.");
+
   setup_from_mutation_parameters();
 
   // Do this AFTER setup
@@ -152,6 +194,11 @@ DialogMutationParameters::DialogMutationParameters(QMainWindow* parent,MutationP
 
   connect(_checkbox_autocool_enable,SIGNAL(stateChanged(int)),this,SLOT(changed_autocool_enable(int)));
   connect(_spinbox_autocool_halflife,SIGNAL(valueChanged(int)),this,SLOT(changed_autocool_halflife(int)));
+
+  connect(_spinbox_probe_threshold,SIGNAL(valueChanged(int)),this,SLOT(changed_probe_threshold(int)));
+
+  connect(_spinbox_cost_budget,SIGNAL(valueChanged(int)),this,SLOT(changed_cost_budget(int)));
+  connect(_spinbox_parsimony,SIGNAL(valueChanged(int)),this,SLOT(changed_parsimony(int)));
  
   _ok=new QPushButton("OK");
   layout()->addWidget(_ok);
@@ -184,6 +231,11 @@ void DialogMutationParameters::setup_from_mutation_parameters()
   _spinbox_autocool_halflife->setValue(_mutation_parameters->autocool_halflife());
   _label_autocool_generations->setText(QString("Generations: ")+QString::number(_mutation_parameters->autocool_generations()));
 
+  _spinbox_probe_threshold->setValue(static_cast<int>(0.5+_scale*_mutation_parameters->probe_threshold()));
+
+  _spinbox_cost_budget->setValue(static_cast<int>(0.5+1e6*_mutation_parameters->cost_budget()));
+  _spinbox_parsimony->setValue(static_cast<int>(0.5+_scale*_mutation_parameters->parsimony()));
+
   // Grey-out any irrelevant settings
   _spinbox_autocool_halflife->setEnabled(_mutation_parameters->autocool_enable());
   _button_autocool_reheat->setEnabled(_mutation_parameters->autocool_enable() && _mutation_parameters->autocool_generations()>0);
@@ -269,6 +321,21 @@ void DialogMutationParameters::changed_autocool_halflife(int v)
   _mutation_parameters->autocool_halflife(v);
 }
 
+void DialogMutationParameters::changed_probe_threshold(int v)
+{
+  _mutation_parameters->probe_threshold(v/static_cast<real>(_scale));
+}
+
+void DialogMutationParameters::changed_cost_budget(int v)
+{
+  _mutation_parameters->cost_budget(1e-6*v);
+}
+
+void DialogMutationParameters::changed_parsimony(int v)
+{
+  _mutation_parameters->parsimony(v/static_cast<real>(_scale));
+}
+
 void DialogMutationParameters::mutation_parameters_changed()
 {
   setup_from_mutation_parameters();
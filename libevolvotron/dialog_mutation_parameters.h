@@ -68,6 +68,18 @@ class DialogMutationParameters : public QDialog
   //! Label to show number of generations
   QLabel* _label_autocool_generations;
 
+  //! Group for probe parameters
+  QWidget* _vbox_probe;
+
+  //! Grid for probe parameters
+  QWidget* _grid_probe;
+
+  //! Group for cost parameters
+  QWidget* _vbox_cost;
+
+  //! Grid for cost parameters
+  QWidget* _grid_cost;
+
   //! Button to reheeat autocooling
   QPushButton* _button_autocool_reheat;
 
@@ -89,6 +101,9 @@ class DialogMutationParameters : public QDialog
   QSpinBox* _spinbox_insert;
   QSpinBox* _spinbox_substitute;
   QSpinBox* _spinbox_autocool_halflife;
+  QSpinBox* _spinbox_probe_threshold;
+  QSpinBox* _spinbox_cost_budget;
+  QSpinBox* _spinbox_parsimony;
   //@}
 
   //! Control autocooling
@@ -131,6 +146,9 @@ class DialogMutationParameters : public QDialog
   void changed_insert(int v);
   void changed_substitute(int v);
   void changed_autocool_halflife(int v);
+  void changed_probe_threshold(int v);
+  void changed_cost_budget(int v);
+  void changed_parsimony(int v);
   //@}
 
   //! Signalled by mutation parameters
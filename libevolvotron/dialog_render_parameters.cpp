@@ -58,10 +58,27 @@ DialogRenderParameters::DialogRenderParameters(QMainWindow* parent,RenderParamet
   _buttongroup->addButton(button[2],3);
   _buttongroup->addButton(button[3],4);
 
+  QGroupBox*const threads_box=new QGroupBox("Compute threads");
+  threads_box->setLayout(new QHBoxLayout);
+  layout()->addWidget(threads_box);
+  threads_box->layout()->addWidget(new QLabel("Enlargement share"));
+  threads_box->layout()->addWidget(_spinbox_enlargement_share=new QSpinBox);
+  _spinbox_enlargement_share->setRange(1,99);
+  _spinbox_enlargement_share->setSuffix("%");
+  _spinbox_enlargement_share->setToolTip("Share of the compute threads enlargements get while the grid is busy too (the grid gets the rest).  Either uses all the threads when the other has nothing to do.");
+  threads_box->layout()->addWidget(new QLabel("Task budget"));
+  threads_box->layout()->addWidget(_spinbox_task_budget=new QSpinBox);
+  _spinbox_task_budget->setRange(0,10000);
+  _spinbox_task_budget->setSuffix("us/sample");
+  _spinbox_task_budget->setSpecialValueText("Off");
+  _spinbox_task_budget->setToolTip("Compute time a task may take per sample before the rest of it is rendered more coarsely (without antialiasing, and with iterations capped), freeing its thread sooner.  Images so rendered are marked by a yellow corner.");
+
   setup_from_render_parameters();
 
   connect(_checkbox_jittered_samples,SIGNAL(stateChanged(int)),this,SLOT(changed_jittered_samples(int)));
   connect(_buttongroup,SIGNAL(buttonClicked(int)),this,SLOT(changed_oversampling(int)));
+  connect(_spinbox_enlargement_share,SIGNAL(valueChanged(int)),this,SLOT(changed_enlargement_share(int)));
+  connect(_spinbox_task_budget,SIGNAL(valueChanged(int)),this,SLOT(changed_task_budget(int)));
  
   _ok=new QPushButton("OK");
   _ok->setDefault(true);
@@ -76,6 +93,11 @@ DialogRenderParameters::DialogRenderParameters(QMainWindow* parent,RenderParamet
 	  _render_parameters,SIGNAL(changed()),
 	  this,SLOT(render_parameters_changed())
 	  );
+
+  connect(
+	  _render_parameters,SIGNAL(farm_settings_changed()),
+	  this,SLOT(render_parameters_changed())
+	  );
 }
 
 DialogRenderParameters::~DialogRenderParameters()
@@ -90,6 +112,9 @@ void DialogRenderParameters::setup_from_render_parameters()
     {
       which_button->click();
     }
+
+  _spinbox_enlargement_share->setValue(_render_parameters->enlargement_share());
+  _spinbox_task_budget->setValue(_render_parameters->task_budget());
 }
 
 void DialogRenderParameters::changed_jittered_samples(int buttonstate)
@@ -104,6 +129,16 @@ void DialogRenderParameters::changed_oversampling(int id)
   _render_parameters->multisample_grid(id);
 }
 
+void DialogRenderParameters::changed_enlargement_share(int v)
+{
+  _render_parameters->enlargement_share(v);
+}
+
+void DialogRenderParameters::changed_task_budget(int v)
+{
+  _render_parameters->task_budget(v);
+}
+
 void DialogRenderParameters::render_parameters_changed()
 {
   setup_from_render_parameters();
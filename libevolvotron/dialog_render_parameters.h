@@ -49,6 +49,12 @@ class DialogRenderParameters : public QDialog
   //! Chooses between multisampling levels.
   QButtonGroup* _buttongroup;
 
+  //! Sets the share of compute threads for enlargements.
+  QSpinBox* _spinbox_enlargement_share;
+
+  //! Sets the compute time allowed per sample of a task.
+  QSpinBox* _spinbox_task_budget;
+
   //! Button to close dialog.
   QPushButton* _ok;
 
@@ -70,6 +76,12 @@ class DialogRenderParameters : public QDialog
   //! Signalled by radio buttons.
   void changed_oversampling(int id);
 
+  //! Signalled by spinbox.
+  void changed_enlargement_share(int v);
+
+  //! Signalled by spinbox.
+  void changed_task_budget(int v);
+
   //! Signalled by mutation parameters
   void render_parameters_changed();
 };
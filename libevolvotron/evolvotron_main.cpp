@@ -30,12 +30,15 @@
 #include "dialog_help.h"
 #include "dialog_mutation_parameters.h"
 #include "dialog_render_parameters.h"
+#include "dialog_farm_stats.h"
 #include "dialog_functions.h"
 #include "dialog_favourite.h"
+#include "function_cost.h"
 #include "function_node.h"
 #include "function_post_transform.h"
 #include "function_pre_transform.h"
 #include "function_top.h"
+#include "mutatable_image_computer_trace.h"
 
 void EvolvotronMain::History::purge()
 {
@@ -167,6 +170,17 @@ void EvolvotronMain::History::undo()
   _main->set_undoable(undoable(),action_name);
 }
 
+bool EvolvotronMain::History::evict_oldest(uint keep)
+{
+  if (_archive.size()<=keep) return false;
+
+  purge();
+
+  const std::string action_name(_archive.empty() ? "" : _archive.front().first);
+  _main->set_undoable(undoable(),action_name);
+  return true;
+}
+
 void EvolvotronMain::last_spawned_image(const boost::shared_ptr<const MutatableImage>& image,SpawnMemberFn method)
 {
   _last_spawned_image=image;
@@ -174,7 +188,7 @@ void EvolvotronMain::last_spawned_image(const boost::shared_ptr<const MutatableI
 }
 
 /*! Constructor sets up GUI components and fires up QTimer.
-  Initialises mutation parameters using time, so different every time.
+  Mutation parameters' random numbers come from seed (pass the time for something different every time).
  */
 EvolvotronMain::EvolvotronMain
 (
@@ -183,9 +197,7 @@ EvolvotronMain::EvolvotronMain
  uint frames,
  uint framerate,
  uint n_threads,
- bool separate_farm_for_enlargements,
- int niceness_grid,
- int niceness_enlargements,
+ int niceness,
  bool start_fullscreen,
  bool start_menuhidden,
  bool autocool,
@@ -195,7 +207,8 @@ EvolvotronMain::EvolvotronMain
  bool linear_zsweep,
  bool spheremap,
  const std::vector<std::string>& startup_filenames,
- bool startup_shuffle
+ bool startup_shuffle,
+ uint seed
  )
   :QMainWindow(parent)
   ,_history(new EvolvotronMain::History(this))
@@ -203,10 +216,15 @@ EvolvotronMain::EvolvotronMain
   ,_spheremap(spheremap)
   ,_startup_filenames(startup_filenames)
   ,_startup_shuffle(startup_shuffle)
-  ,_mutation_parameters(time(0),autocool,function_debug_mode,this)
+  ,_mutation_parameters(seed,autocool,function_debug_mode,this)
   ,_render_parameters(jitter,multisample_level,this)
   ,_statusbar_tasks_main(0)
   ,_statusbar_tasks_enlargement(0)
+  ,_statusbar_probes(0)
+  ,_probes(0)
+  ,_probe_rejections(0)
+  ,_longest_delivery_stall(0)
+  ,_memory_cap_unmet(false)
   ,_last_spawn_method(&EvolvotronMain::spawn_normal)
 {
   setAttribute(Qt::WA_DeleteOnClose,true);
@@ -214,6 +232,11 @@ EvolvotronMain::EvolvotronMain
 
   setMinimumSize(640,480);
 
+  // Probes look for some colour variation and some structure, but not per-pixel noise (which has plenty of both)
+  _probe_score.add(std::auto_ptr<ImageMetric>(new ImageMetricColourVariance()),1.0);
+  _probe_score.add(std::auto_ptr<ImageMetric>(new ImageMetricEdgeDensity()),1.0);
+  _probe_score.add(std::auto_ptr<ImageMetric>(new ImageMetricCoherence()),2.0);
+
   // Need to create this first or DialogMutationParameters might cause one to be created too.
   _statusbar=new QStatusBar;
   _statusbar->setSizeGripEnabled(true);
@@ -221,7 +244,19 @@ EvolvotronMain::EvolvotronMain
 
   _statusbar->addWidget(_statusbar_tasks_label=new QLabel("Ready"));
 
-  _dialog_about=new DialogAbout(this,n_threads,separate_farm_for_enlargements);
+  // Rendering is scheduled by estimated cost: measure the function classes before the compute threads start.
+  if (!FunctionCost::calibrated()) FunctionCost::calibrate();
+
+  // Created early so the dialogs can refer to it.
+  _farm=std::auto_ptr<MutatableImageComputerFarm>(new MutatableImageComputerFarm(n_threads,niceness,this));
+  render_farm_settings_changed();
+
+  connect(
+	  &_render_parameters,SIGNAL(farm_settings_changed()),
+	  this,SLOT(render_farm_settings_changed())
+	  );
+
+  _dialog_about=new DialogAbout(this,n_threads);
   _dialog_help_short=new DialogHelp(this,false);
   _dialog_help_long=new DialogHelp(this,true);
 
@@ -229,6 +264,8 @@ EvolvotronMain::EvolvotronMain
 
   _dialog_render_parameters=new DialogRenderParameters(this,&_render_parameters);
 
+  _dialog_farm_stats=new DialogFarmStats(this,*_farm);
+
   _dialog_functions=new DialogFunctions(this,&_mutation_parameters);
 
   _dialog_favourite=new DialogFavourite(this);
@@ -254,6 +291,7 @@ EvolvotronMain::EvolvotronMain
   _popupmenu_settings->addSeparator();
 
   _popupmenu_settings->addAction("Render parameters...",_dialog_render_parameters,SLOT(show()));  
+  _popupmenu_settings->addAction("Compute statistics...",_dialog_farm_stats,SLOT(show()));
 
   _popupmenu_settings->addSeparator();
 
@@ -297,12 +335,6 @@ EvolvotronMain::EvolvotronMain
 	  );
   
 
-  _farm[0]=std::auto_ptr<MutatableImageComputerFarm>(new MutatableImageComputerFarm(n_threads,niceness_grid));
-  if (separate_farm_for_enlargements)
-    {
-      _farm[1]=std::auto_ptr<MutatableImageComputerFarm>(new MutatableImageComputerFarm(n_threads,niceness_enlargements));
-    }
-
   _grid=new QWidget;
   QGridLayout*const grid_layout=new QGridLayout;
   _grid->setLayout(grid_layout);
@@ -322,8 +354,8 @@ EvolvotronMain::EvolvotronMain
 	  _timer,SIGNAL(timeout()),
 	  this, SLOT(tick()) 
 	  );
-  // Run tick() at 100Hz
-  _timer->start(10);
+  // Run tick() at 10Hz.  It only updates the status bar; completed tasks are delivered as they arrive.
+  _timer->start(100);
 
   if (start_fullscreen)
     {
@@ -354,9 +386,15 @@ EvolvotronMain::~EvolvotronMain()
 
   std::clog << "...cleared displays, deleting farm...\n";
 
-  // Shut down the compute farms
-  _farm[0].reset();
-  _farm[1].reset();
+  // One last line of statistics, while there's still a farm to ask.
+  if (_stats_file.get())
+    write_stats();
+
+  // Shut down the compute farm
+  _farm.reset();
+
+  // No compute threads left to record anything, so the trace (if any) is complete.
+  MutatableImageComputerTrace::write();
 
   std::clog << "...deleted farm, deleting history...\n";
 
@@ -394,7 +432,7 @@ void EvolvotronMain::spawn_normal(const boost::shared_ptr<const MutatableImage>&
   while (new_image_function->is_constant());
   
   history().replacing(display);
-  display->image_function(new_image_function,one_of_many);
+  display->image_function_probed(new_image_function,image_function,one_of_many);
 }
 
 void EvolvotronMain::spawn_recoloured(const boost::shared_ptr<const MutatableImage>& image_function,MutatableImageDisplay* display,bool one_of_many)
@@ -544,13 +582,80 @@ void EvolvotronMain::list_known(std::ostream& out) const
   out << "\n";
 }
 
-/*! Periodically report number of remaining compute tasks and check farm's done queue for completed tasks.
+bool EvolvotronMain::stats_file(const std::string& filename)
+{
+  _stats_file=std::auto_ptr<std::ofstream>(new std::ofstream(filename.c_str()));
+  if (!*_stats_file)
+    {
+      _stats_file.reset();
+      return false;
+    }
+  _stats_written=_farm->stats();
+  return true;
+}
+
+void EvolvotronMain::write_stats()
+{
+  const MutatableImageComputerFarm::Stats stats(_farm->stats());
+  MutatableImageComputerFarm::report_json(*_stats_file,_stats_written,stats) << std::endl;
+  _stats_written=stats;
+}
+
+/*! Unseen images are only a recompute away from being back, so they go first.
+  Undo history is gone for good, so it goes last, oldest first, and the last 4 steps are always kept.
+  The trees an undo step holds are only freed if no display is still showing them,
+  so if discarding one frees nothing the cap can't be met by discarding more:
+  undo is then left alone until usage has been back under the cap.
+ */
+void EvolvotronMain::enforce_memory_cap()
+{
+  // Undo steps kept however far over the cap we are.
+  const uint min_undo_steps=4;
+
+  if (!MemoryAccount::over_cap())
+    {
+      _memory_cap_unmet=false;
+      return;
+    }
+
+  const unsigned long long before=MemoryAccount::total();
+  uint released=0;
+  for (std::set<MutatableImageDisplay*>::const_iterator it=_known_displays.begin();it!=_known_displays.end() && MemoryAccount::over_cap();it++)
+    if ((*it)->release_images()) released++;
+
+  uint evicted=0;
+  while (!_memory_cap_unmet && MemoryAccount::over_cap())
+    {
+      const unsigned long long total=MemoryAccount::total();
+      const bool discarded=_history->evict_oldest(min_undo_steps);
+      if (discarded) evicted++;
+      if (!discarded || MemoryAccount::total()>=total)
+	{
+	  _memory_cap_unmet=true;
+	  std::cerr
+	    << "Memory cap of " << MemoryAccount::cap()/1048576 << "MB can't be met: "
+	    << MemoryAccount::total()/1048576 << "MB is held by what's on display and recent undo steps\n";
+	}
+    }
+
+  if (released || evicted)
+    std::clog
+      << "Over memory cap: released images of " << released << " unseen displays and " << evicted << " undo steps, "
+      << (before>MemoryAccount::total() ? before-MemoryAccount::total() : 0)/1048576 << "MB freed\n";
+}
+
+/*! Periodically report number of remaining compute tasks (and write statistics and enforce the memory cap, if wanted).
  */
 void EvolvotronMain::tick()
 {
-  const uint tasks_main=_farm[0]->tasks();
-  const uint tasks_enlargement=(_farm[1].get() ? _farm[1]->tasks() : 0);
-  if (tasks_main!=_statusbar_tasks_main || tasks_enlargement!=_statusbar_tasks_enlargement)
+  enforce_memory_cap();
+
+  if (_stats_file.get() && FunctionProfile::now()-_stats_written.time>=1.0)
+    write_stats();
+
+  const uint tasks_main=_farm->tasks(false);
+  const uint tasks_enlargement=_farm->tasks(true);
+  if (tasks_main!=_statusbar_tasks_main || tasks_enlargement!=_statusbar_tasks_enlargement || _probes!=_statusbar_probes)
     {
       std::ostringstream msg;
       msg << "";
@@ -569,41 +674,65 @@ void EvolvotronMain::tick()
 	  msg << " tasks remaining";
 	}
 
+      if (_probes)
+	{
+	  msg << " (probe rejected " << _probe_rejections << "/" << _probes << ")";
+	}
+
       _statusbar_tasks_label->setText(msg.str().c_str());
       _statusbar_tasks_main=tasks_main;
       _statusbar_tasks_enlargement=tasks_enlargement;
+      _statusbar_probes=_probes;
     }
+}
 
+/*! The farm invokes this once for a batch of completions (not once per task),
+  so a burst of small tasks doesn't flood the event loop.
+ */
+void EvolvotronMain::tasks_done()
+{
   boost::shared_ptr<MutatableImageComputerTask> task;
 
-  // If there are aborted jobs in the todo queue 
-  // shift them straight over to done queue so the compute threads don't have to worry about them.
-  _farm[0]->fasttrack_aborted();
-  if (_farm[1].get()) _farm[1]->fasttrack_aborted();
+  bool timed_out=false;
 
   QTime watchdog;
   watchdog.start();
 
-  for (int which_farm=0;which_farm<(_farm[1].get() ? 2 : 1);which_farm++)
+  while ((task=_farm->pop_done())!=0)
     {
-      while ((task=_farm[which_farm]->pop_done())!=0)
+      if (is_known(task->display()))
 	{
-	  if (is_known(task->display()))
-	    {
-	      task->display()->deliver(task);
-	    }
-	  else
-	    {
-	      // If we don't know who owns it we just have to trash it 
-	      // (probably a top level window which was closed with incomplete tasks).
-	      task.reset();
-	    }
-	  
-	  // Timeout in case we're being swamped by incoming tasks (maintain app responsiveness).
-	  if (watchdog.elapsed()>20)
-	    break;
+	  MutatableImageComputerTrace::record(MutatableImageComputerTrace::Deliver,*task);
+	  task->display()->deliver(task);
+	}
+      else
+	{
+	  // If we don't know who owns it we just have to trash it 
+	  // (probably a top level window which was closed with incomplete tasks).
+	  task.reset();
+	}
+      
+      // Timeout in case we're being swamped by incoming tasks (maintain app responsiveness).
+      if (watchdog.elapsed()>20)
+	{
+	  timed_out=true;
+	  break;
 	}
     }
+
+  // The farm won't ask again for tasks it's already handed over, so come back for the rest after handling any input.
+  if (timed_out)
+    {
+      QMetaObject::invokeMethod(this,"tasks_done",Qt::QueuedConnection);
+    }
+
+  // Log new worsts, so the GUI-side cost of delivery can be compared between builds (run with -v).
+  const int stall=watchdog.elapsed();
+  if (stall>_longest_delivery_stall)
+    {
+      _longest_delivery_stall=stall;
+      std::clog << "Longest delivery stall so far: " << stall << "ms\n";
+    }
 }    
 
 void EvolvotronMain::keyPressEvent(QKeyEvent* e)
@@ -667,7 +796,7 @@ void EvolvotronMain::toggle_hide_menu()
 /*! Set up an initial random image in the specified display. 
   If a favourite function was specified then we use that as the top level node.
  */
-void EvolvotronMain::reset(MutatableImageDisplay* display)
+boost::shared_ptr<const MutatableImage> EvolvotronMain::random_image_function()
 {
   std::auto_ptr<FunctionTop> root;
   if (_dialog_favourite->favourite_function().empty())
@@ -687,9 +816,39 @@ void EvolvotronMain::reset(MutatableImageDisplay* display)
 	 );
     }
 
+  return boost::shared_ptr<const MutatableImage>(new MutatableImage(root,!_linear_zsweep,_spheremap,false));
+}
+
+void EvolvotronMain::reset(MutatableImageDisplay* display)
+{
   history().replacing(display);
-  const boost::shared_ptr<const MutatableImage> image_function(new MutatableImage(root,!_linear_zsweep,_spheremap,false));
-  display->image_function(image_function,true);
+  display->image_function_probed(random_image_function(),boost::shared_ptr<const MutatableImage>(),true);
+}
+
+void EvolvotronMain::probe_reported(bool accepted)
+{
+  _probes++;
+  if (!accepted) _probe_rejections++;
+  std::clog << "Probe " << (accepted ? "accepted" : "rejected") << " image (" << _probe_rejections << "/" << _probes << " rejected so far)\n";
+}
+
+void EvolvotronMain::first_pixels_delivered(int ms)
+{
+  _farm->first_pixels_delivered(ms);
+  std::clog << "Time to first pixels: " << ms << "ms (mean " << _farm->first_pixels_mean() << "ms so far)\n";
+}
+
+boost::shared_ptr<const MutatableImage> EvolvotronMain::probe_replacement(const boost::shared_ptr<const MutatableImage>& parent)
+{
+  if (!parent.get()) return random_image_function();
+
+  boost::shared_ptr<const MutatableImage> image_function;
+  do
+    {
+      image_function=parent->mutated(mutation_parameters());
+    }
+  while (image_function->is_constant());
+  return image_function;
 }
 
 void EvolvotronMain::undo()
@@ -789,6 +948,12 @@ void EvolvotronMain::mutation_parameters_changed()
     }
 }
 
+void EvolvotronMain::render_farm_settings_changed()
+{
+  _farm->shares(100-_render_parameters.enlargement_share(),_render_parameters.enlargement_share());
+  _farm->task_budget(1e-6*_render_parameters.task_budget());
+}
+
 void EvolvotronMain::render_parameters_changed()
 {
   for (std::set<MutatableImageDisplay*>::iterator it=_known_displays.begin();it!=_known_displays.end();it++)
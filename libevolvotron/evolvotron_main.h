@@ -25,6 +25,7 @@
 #define _evolvotron_main_h_
 
 #include "function_registry.h"
+#include "image_metric.h"
 #include "transform_factory.h"
 
 #include "mutatable_image.h"
@@ -37,6 +38,7 @@ class DialogAbout;
 class DialogHelp;
 class DialogMutationParameters;
 class DialogRenderParameters;
+class DialogFarmStats;
 class DialogFunctions;
 class DialogFavourite;
 
@@ -123,6 +125,9 @@ class EvolvotronMain : public QMainWindow
 
       //! Implements an undo.
       void undo();
+
+      //! Discard the oldest undo slot (to save memory), unless only keep are left.  Returns false if nothing was discarded.
+      bool evict_oldest(uint keep);
     };
 
  protected:
@@ -173,6 +178,26 @@ class EvolvotronMain : public QMainWindow
    */
   uint _statusbar_tasks_enlargement;
 
+  //! Number of probe results the statusbar is currently reporting.
+  /*! Cached to avoid unnecessarily regenerating message
+   */
+  uint _statusbar_probes;
+
+  //! Scoring used for probe renders.
+  ImageScore _probe_score;
+
+  //! Number of probe renders completed.
+  uint _probes;
+
+  //! Number of images rejected by probe renders.
+  uint _probe_rejections;
+
+  //! Longest time (ms) tasks_done has spent delivering completed tasks, i.e not responding to input.
+  int _longest_delivery_stall;
+
+  //! Whether the memory cap has been found unachievable (and warned about), so undo steps are left alone until usage is back under it.
+  bool _memory_cap_unmet;
+
   //! The "About" dialog widget.
   DialogAbout* _dialog_about;
 
@@ -188,6 +213,9 @@ class EvolvotronMain : public QMainWindow
   //! The dialog for adjusting RenderParameters.
   DialogRenderParameters* _dialog_render_parameters;
 
+  //! The dialog showing compute farm statistics.
+  DialogFarmStats* _dialog_farm_stats;
+
   //! Dialog for controlling which functions are in use.
   DialogFunctions* _dialog_functions;
 
@@ -227,11 +255,23 @@ class EvolvotronMain : public QMainWindow
   //! Grid for image display areas
   QWidget* _grid;
 
-  //! Timer to drive tick() slot
+  //! Timer to drive tick() slot (status bar and statistics updates only: completed tasks arrive via tasks_done)
   QTimer* _timer;
 
-  //! Two farms of compute threads.  One for the main display, one for enlargements.
-  std::auto_ptr<MutatableImageComputerFarm> _farm[2];
+  //! File compute farm statistics are periodically written to (null if none).
+  std::auto_ptr<std::ofstream> _stats_file;
+
+  //! Snapshot of the farm's counters when statistics were last written.
+  MutatableImageComputerFarm::Stats _stats_written;
+
+  //! Append a line of farm statistics to _stats_file.
+  void write_stats();
+
+  //! If over the soft memory cap, release what can be done without: images nobody can see, then undo history.
+  void enforce_memory_cap();
+
+  //! The compute threads, shared by the grid and enlargements.
+  std::auto_ptr<MutatableImageComputerFarm> _farm;
 
   //! All the displays in the grid.
   std::vector<MutatableImageDisplay*> _displays;
@@ -293,6 +333,9 @@ class EvolvotronMain : public QMainWindow
   //! Spawn the specified display using the specified method.
   void spawn_all(MutatableImageDisplay* display,SpawnMemberFn method,const std::string& action_name);
 
+  //! Create a new random image (using any favourite function).
+  boost::shared_ptr<const MutatableImage> random_image_function();
+
  public:
   //! Constructor.
   EvolvotronMain
@@ -302,9 +345,7 @@ class EvolvotronMain : public QMainWindow
      uint frames,
      uint framerate,
      uint n_threads,
-     bool separate_farm_for_enlargements,
-     int niceness_grid,
-     int niceness_enlargements,
+     int niceness,
      bool start_fullscreen,
      bool start_menuhidden,
      bool autocool,
@@ -314,7 +355,8 @@ class EvolvotronMain : public QMainWindow
      bool linear_zsweep,
      bool spheremap,
      const std::vector<std::string>& startup_filenames,
-     bool startup_shuffle
+     bool startup_shuffle,
+     uint seed
      );
 
   //! Destructor.
@@ -326,6 +368,9 @@ class EvolvotronMain : public QMainWindow
   //! Accessor.  Forwards to DialogFavourite.
   void favourite_function_unwrapped(bool v);
 
+  //! Write compute farm statistics to the given file every second (as one JSON object per line).  Returns false if the file can't be opened.
+  bool stats_file(const std::string& filename);
+
   //! Accessor.  
   std::vector<MutatableImageDisplay*>& displays()
     {
@@ -348,10 +393,10 @@ class EvolvotronMain : public QMainWindow
       return _render_parameters;
     }
 
-  //! Returns which farm to use for purpose.
-  MutatableImageComputerFarm& farm(bool enlargement)
+  //! Accessor.
+  MutatableImageComputerFarm& farm()
     {
-      return *_farm[enlargement && _farm[1].get()];
+      return *_farm;
     }
 
   //! Accessor.
@@ -390,6 +435,21 @@ class EvolvotronMain : public QMainWindow
   //! Write a list of known displays (for debugging)
   void list_known(std::ostream& out) const;
 
+  //! Accessor.
+  const ImageScore& probe_score() const
+    {
+      return _probe_score;
+    }
+
+  //! Called by displays to count probe results for reporting.
+  void probe_reported(bool accepted);
+
+  //! Called by displays when the first pixels of a newly loaded image are delivered, ms after the load.
+  void first_pixels_delivered(int ms);
+
+  //! Return an image to replace one rejected by a probe: a new mutant of parent, or a new random image if parent is null.
+  boost::shared_ptr<const MutatableImage> probe_replacement(const boost::shared_ptr<const MutatableImage>& parent);
+
  protected:
   //! Handle key-presses
   void keyPressEvent(QKeyEvent* e);
@@ -401,6 +461,9 @@ class EvolvotronMain : public QMainWindow
   //! Signalled by timer.
   void tick();
 
+  //! Invoked (queued) by the farms when completed tasks are waiting to be delivered.
+  void tasks_done();
+
   //! Signalled by menu item.  Forwards to History object.
   void undo();
 
@@ -431,6 +494,9 @@ class EvolvotronMain : public QMainWindow
 
   //! So we can re-render when render parameters change
   void render_parameters_changed();
+
+  //! So the farm can pick up new thread shares and task budget (no re-render needed)
+  void render_farm_settings_changed();
 };
 
 #endif
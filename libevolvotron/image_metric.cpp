@@ -0,0 +1,188 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class ImageMetric and derived classes.
+*/
+
+#include "libevolvotron_precompiled.h"
+
+#include "image_metric.h"
+
+namespace
+{
+  //! Integer luminance (0-255) of an RGB32 pixel.
+  inline int luminance(QRgb p)
+  {
+    return (77*qRed(p)+150*qGreen(p)+29*qBlue(p))>>8;
+  }
+}
+
+std::auto_ptr<ImageMetric> ImageMetric::create(const std::string& name)
+{
+  if (name=="entropy") return std::auto_ptr<ImageMetric>(new ImageMetricEntropy());
+  else if (name=="edges") return std::auto_ptr<ImageMetric>(new ImageMetricEdgeDensity());
+  else if (name=="variance") return std::auto_ptr<ImageMetric>(new ImageMetricColourVariance());
+  else if (name=="coherence") return std::auto_ptr<ImageMetric>(new ImageMetricCoherence());
+  else return std::auto_ptr<ImageMetric>();
+}
+
+const std::vector<std::string> ImageMetric::names()
+{
+  std::vector<std::string> ret;
+  ret.push_back("entropy");
+  ret.push_back("edges");
+  ret.push_back("variance");
+  ret.push_back("coherence");
+  return ret;
+}
+
+real ImageMetricEntropy::operator()(const QImage& image) const
+{
+  const int n=image.width()*image.height();
+  if (n==0) return 0.0;
+
+  boost::array<uint,256> histogram;
+  histogram.assign(0);
+
+  for (int y=0;y<image.height();y++)
+    {
+      const QRgb*const line=reinterpret_cast<const QRgb*>(image.scanLine(y));
+      for (int x=0;x<image.width();x++)
+	histogram[luminance(line[x])]++;
+    }
+
+  real entropy=0.0;
+  for (uint i=0;i<256;i++)
+    if (histogram[i])
+      {
+	const real p=histogram[i]/static_cast<real>(n);
+	entropy-=p*log(p);
+      }
+
+  // Can't exceed the entropy of n equiprobable values either, so small images aren't penalised
+  return entropy/log(static_cast<real>(std::min(n,256)));
+}
+
+real ImageMetricEdgeDensity::operator()(const QImage& image) const
+{
+  if (image.width()<2 || image.height()<2) return 0.0;
+
+  uint edges=0;
+  for (int y=0;y<image.height()-1;y++)
+    {
+      const QRgb*const line0=reinterpret_cast<const QRgb*>(image.scanLine(y));
+      const QRgb*const line1=reinterpret_cast<const QRgb*>(image.scanLine(y+1));
+      for (int x=0;x<image.width()-1;x++)
+	{
+	  const int l=luminance(line0[x]);
+	  const int g=abs(luminance(line0[x+1])-l)+abs(luminance(line1[x])-l);
+	  if (g>_threshold) edges++;
+	}
+    }
+  return edges/static_cast<real>((image.width()-1)*(image.height()-1));
+}
+
+real ImageMetricColourVariance::operator()(const QImage& image) const
+{
+  const int n=image.width()*image.height();
+  if (n==0) return 0.0;
+
+  XYZ sum(0.0,0.0,0.0);
+  XYZ sum2(0.0,0.0,0.0);
+  for (int y=0;y<image.height();y++)
+    {
+      const QRgb*const line=reinterpret_cast<const QRgb*>(image.scanLine(y));
+      for (int x=0;x<image.width();x++)
+	{
+	  const XYZ c(qRed(line[x]),qGreen(line[x]),qBlue(line[x]));
+	  sum+=c;
+	  sum2+=XYZ(c.x()*c.x(),c.y()*c.y(),c.z()*c.z());
+	}
+    }
+  const XYZ mean(sum/n);
+  const XYZ variance(sum2/n-XYZ(mean.x()*mean.x(),mean.y()*mean.y(),mean.z()*mean.z()));
+
+  // Largest possible variance for values in 0-255 is 127.5^2
+  return std::max(0.0,(variance.x()+variance.y()+variance.z())/(3.0*127.5*127.5));
+}
+
+real ImageMetricCoherence::operator()(const QImage& image) const
+{
+  if (image.width()<2 || image.height()<2) return 0.0;
+
+  // Accumulate over (pixel,neighbour) pairs, both horizontal and vertical.
+  real sum=0.0;
+  real sum2=0.0;
+  real sum_products=0.0;
+  uint pairs=0;
+  for (int y=0;y<image.height()-1;y++)
+    {
+      const QRgb*const line0=reinterpret_cast<const QRgb*>(image.scanLine(y));
+      const QRgb*const line1=reinterpret_cast<const QRgb*>(image.scanLine(y+1));
+      for (int x=0;x<image.width()-1;x++)
+	{
+	  const real l=luminance(line0[x]);
+	  const real r=luminance(line0[x+1]);
+	  const real d=luminance(line1[x]);
+	  sum+=2.0*l+r+d;
+	  sum2+=2.0*l*l+r*r+d*d;
+	  sum_products+=l*r+l*d;
+	  pairs+=2;
+	}
+    }
+  const real mean=sum/(2*pairs);
+  const real variance=sum2/(2*pairs)-mean*mean;
+  if (variance<1.0) return 0.0;
+
+  const real covariance=sum_products/pairs-mean*mean;
+  return clamped(covariance/variance,0.0,1.0);
+}
+
+ImageScore::ImageScore(const ImageScore& other)
+  :_weights(other._weights)
+{
+  for (boost::ptr_vector<ImageMetric>::const_iterator it=other._metrics.begin();it!=other._metrics.end();it++)
+    _metrics.push_back(it->clone().release());
+}
+
+void ImageScore::add(std::auto_ptr<ImageMetric> metric,real weight)
+{
+  _metrics.push_back(metric.release());
+  _weights.push_back(weight);
+}
+
+real ImageScore::operator()(const QImage& image) const
+{
+  real score=0.0;
+  real total_weight=0.0;
+  for (uint i=0;i<_metrics.size();i++)
+    {
+      score+=_weights[i]*_metrics[i](image);
+      total_weight+=_weights[i];
+    }
+  return (total_weight==0.0 ? 0.0 : score/total_weight);
+}
+
+std::ostream& ImageScore::describe(std::ostream& out) const
+{
+  for (uint i=0;i<_metrics.size();i++)
+    out << (i ? "+" : "") << _weights[i] << "*" << _metrics[i].name();
+  return out;
+}
@@ -0,0 +1,163 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file 
+  \brief Interface for class ImageMetric and derived classes.
+*/
+
+#ifndef _image_metric_h_
+#define _image_metric_h_
+
+//! Abstract base class for measures of how "interesting" an image is.
+/*! Metrics are normalised to return values in [0,1], higher being more interesting,
+  so they can be combined by an ImageScore.
+  Images are expected to be QImage::Format_RGB32, as produced by the compute threads.
+ */
+class ImageMetric
+{
+ public:
+  ImageMetric()
+    {}
+  virtual ~ImageMetric()
+    {}
+
+  //! Clone functionality needed to retain typed copies of metrics.
+  virtual std::auto_ptr<ImageMetric> clone() const
+    =0;
+
+  //! Name used to select the metric (e.g on the command line).
+  virtual const char* name() const
+    =0;
+
+  //! Evaluate the metric on an image.
+  virtual real operator()(const QImage&) const
+    =0;
+
+  //! Return a new metric of the named type, or null if not recognised.
+  static std::auto_ptr<ImageMetric> create(const std::string& name);
+
+  //! Names of all the metrics create() knows about.
+  static const std::vector<std::string> names();
+};
+
+//! Shannon entropy of the luminance histogram, normalised by its 8-bit maximum.
+/*! Low for flat images, high for noise as well as for interesting images; best combined with other metrics.
+ */
+class ImageMetricEntropy : public ImageMetric
+{
+ public:
+  virtual std::auto_ptr<ImageMetric> clone() const
+    {
+      return std::auto_ptr<ImageMetric>(new ImageMetricEntropy());
+    }
+  virtual const char* name() const
+    {
+      return "entropy";
+    }
+  virtual real operator()(const QImage&) const;
+};
+
+//! Proportion of pixels where the luminance gradient exceeds a threshold.
+class ImageMetricEdgeDensity : public ImageMetric
+{
+ public:
+  //! Threshold is on the sum of absolute horizontal and vertical luminance differences (0-255 scale).
+  ImageMetricEdgeDensity(int threshold=32)
+    :_threshold(threshold)
+    {}
+  virtual std::auto_ptr<ImageMetric> clone() const
+    {
+      return std::auto_ptr<ImageMetric>(new ImageMetricEdgeDensity(_threshold));
+    }
+  virtual const char* name() const
+    {
+      return "edges";
+    }
+  virtual real operator()(const QImage&) const;
+ protected:
+  const int _threshold;
+};
+
+//! Mean of the red, green and blue channel variances, normalised by the largest possible variance.
+class ImageMetricColourVariance : public ImageMetric
+{
+ public:
+  virtual std::auto_ptr<ImageMetric> clone() const
+    {
+      return std::auto_ptr<ImageMetric>(new ImageMetricColourVariance());
+    }
+  virtual const char* name() const
+    {
+      return "variance";
+    }
+  virtual real operator()(const QImage&) const;
+};
+
+//! Correlation of each pixel's luminance with its right and lower neighbours' (negative correlations count as 0).
+/*! Near 1 for images with structure at a scale larger than a pixel, near 0 for per-pixel noise
+  (which the other metrics all score highly).  Flat images score 0 too.
+ */
+class ImageMetricCoherence : public ImageMetric
+{
+ public:
+  virtual std::auto_ptr<ImageMetric> clone() const
+    {
+      return std::auto_ptr<ImageMetric>(new ImageMetricCoherence());
+    }
+  virtual const char* name() const
+    {
+      return "coherence";
+    }
+  virtual real operator()(const QImage&) const;
+};
+
+//! Weighted sum of ImageMetrics.
+class ImageScore
+{
+ public:
+  ImageScore()
+    {}
+
+  //! Copy constructor (clones the metrics).
+  ImageScore(const ImageScore&);
+
+  //! Add a metric with the given weight (takes ownership).
+  void add(std::auto_ptr<ImageMetric> metric,real weight);
+
+  //! Whether any metrics have been added.
+  bool empty() const
+    {
+      return _metrics.empty();
+    }
+
+  //! Weighted sum of the metrics, normalised by the total weight.
+  real operator()(const QImage&) const;
+
+  //! Describe the metrics and weights.
+  std::ostream& describe(std::ostream&) const;
+
+ protected:
+  //! The metrics.
+  boost::ptr_vector<ImageMetric> _metrics;
+
+  //! Weight for each metric.
+  std::vector<real> _weights;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class MemoryAccount.
+*/
+
+#include "libevolvotron_precompiled.h"
+
+#include "memory_account.h"
+
+QAtomicInt MemoryAccount::_kilobytes[MemoryAccount::Categories];
+QAtomicInt MemoryAccount::_peak_kilobytes[MemoryAccount::Categories];
+QAtomicInt MemoryAccount::_total_kilobytes;
+QAtomicInt MemoryAccount::_peak_total_kilobytes;
+int MemoryAccount::_cap_kilobytes=0;
+
+namespace
+{
+  //! Rounds up, so even small holders are seen.
+  int kilobytes(size_t bytes)
+  {
+    return static_cast<int>((bytes+1023)/1024);
+  }
+
+  //! Raise a high water mark to at least v.
+  void raise_peak(QAtomicInt& peak,int v)
+  {
+    int p;
+    do
+      {
+	p=peak;
+	if (v<=p) return;
+      }
+    while (!peak.testAndSetOrdered(p,v));
+  }
+}
+
+MemoryAccount::Charge::Charge(Category c,size_t bytes)
+  :_category(c)
+  ,_kilobytes(0)
+{
+  set(bytes);
+}
+
+MemoryAccount::Charge::~Charge()
+{
+  set(0);
+}
+
+void MemoryAccount::Charge::set(size_t bytes)
+{
+  const int k=kilobytes(bytes);
+  if (k!=_kilobytes)
+    {
+      add(_category,k-_kilobytes);
+      _kilobytes=k;
+    }
+}
+
+void MemoryAccount::add(Category c,int k)
+{
+  const int now=_kilobytes[c].fetchAndAddOrdered(k)+k;
+  const int now_total=_total_kilobytes.fetchAndAddOrdered(k)+k;
+  if (k>0)
+    {
+      raise_peak(_peak_kilobytes[c],now);
+      raise_peak(_peak_total_kilobytes,now_total);
+    }
+}
+
+const char* MemoryAccount::name(Category c)
+{
+  switch (c)
+    {
+    case RenderBuffers: return "Render buffers";
+    case DisplayImages: return "Display images";
+    case Tasks: return "Compute tasks";
+    case FunctionTrees: return "Function trees";
+    default: return "Unknown";
+    }
+}
+
+unsigned long long MemoryAccount::bytes(Category c)
+{
+  return 1024ULL*static_cast<int>(_kilobytes[c]);
+}
+
+unsigned long long MemoryAccount::peak(Category c)
+{
+  return 1024ULL*static_cast<int>(_peak_kilobytes[c]);
+}
+
+unsigned long long MemoryAccount::total()
+{
+  return 1024ULL*static_cast<int>(_total_kilobytes);
+}
+
+unsigned long long MemoryAccount::peak_total()
+{
+  return 1024ULL*static_cast<int>(_peak_total_kilobytes);
+}
+
+void MemoryAccount::cap(unsigned long long bytes)
+{
+  _cap_kilobytes=kilobytes(bytes);
+}
+
+unsigned long long MemoryAccount::cap()
+{
+  return 1024ULL*_cap_kilobytes;
+}
+
+bool MemoryAccount::over_cap()
+{
+  return (_cap_kilobytes && static_cast<int>(_total_kilobytes)>_cap_kilobytes);
+}
+
+std::ostream& MemoryAccount::report(std::ostream& out)
+{
+  out
+    << std::setw(16) << "memory"
+    << std::setw(12) << "MB"
+    << std::setw(12) << "peak MB"
+    << "\n";
+  out << std::fixed << std::setprecision(1);
+  for (uint c=0;c<Categories;c++)
+    out
+      << std::setw(16) << name(static_cast<Category>(c))
+      << std::setw(12) << bytes(static_cast<Category>(c))/1048576.0
+      << std::setw(12) << peak(static_cast<Category>(c))/1048576.0
+      << "\n";
+  out
+    << std::setw(16) << "Total"
+    << std::setw(12) << total()/1048576.0
+    << std::setw(12) << peak_total()/1048576.0
+    << "\n";
+  if (_cap_kilobytes)
+    out << std::setw(16) << "Soft cap" << std::setw(12) << cap()/1048576.0 << "\n";
+  return out;
+}
@@ -0,0 +1,116 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class MemoryAccount.
+*/
+
+#ifndef _memory_account_h_
+#define _memory_account_h_
+
+//! Running totals of memory held, by category, in all builds.
+/*! Unlike InstanceCounted (debug builds only, counting objects) this counts bytes,
+  cheaply enough to leave on: holders keep a Charge which is only updated when what they hold changes.
+  Totals are kept in kilobytes with atomic arithmetic, so charges can come and go on any thread.
+  Images shared between holders (QImage is implicitly shared) are counted by each holding them.
+  There's also an optional soft cap: nothing is refused when it's exceeded,
+  but over_cap() tells whoever checks it (see EvolvotronMain::tick) to release what it can.
+ */
+class MemoryAccount
+{
+ public:
+  //! What memory is held for.
+  enum Category
+    {
+      RenderBuffers,   //!< Images being (or just) computed into.
+      DisplayImages,   //!< Images held by displays for painting and saving.
+      Tasks,           //!< Compute task objects.
+      FunctionTrees,   //!< Image function trees (including those only held by the undo history).
+      Categories       //!< Number of categories.
+    };
+
+  //! Memory held against a category, for as long as this exists.
+  class Charge : boost::noncopyable
+    {
+    public:
+      //! Constructor.
+      Charge(Category c,size_t bytes=0);
+
+      //! Destructor releases the charge.
+      ~Charge();
+
+      //! Change the amount held.
+      void set(size_t bytes);
+
+    private:
+      //! What the memory is for.
+      const Category _category;
+
+      //! Amount currently charged.
+      int _kilobytes;
+    };
+
+  //! Display name of a category.
+  static const char* name(Category c);
+
+  //! Bytes currently held against a category.
+  static unsigned long long bytes(Category c);
+
+  //! Most bytes ever held against a category at once.
+  static unsigned long long peak(Category c);
+
+  //! Bytes currently held in total.
+  static unsigned long long total();
+
+  //! Most bytes ever held in total at once.
+  static unsigned long long peak_total();
+
+  //! Set the soft cap in bytes (0 for none).
+  static void cap(unsigned long long bytes);
+
+  //! Soft cap in bytes (0 if none).
+  static unsigned long long cap();
+
+  //! Whether the total held is over the soft cap.
+  static bool over_cap();
+
+  //! Write a table of current and peak usage.
+  static std::ostream& report(std::ostream& out);
+
+ private:
+  //! Kilobytes held per category.
+  static QAtomicInt _kilobytes[Categories];
+
+  //! Peak kilobytes held per category.
+  static QAtomicInt _peak_kilobytes[Categories];
+
+  //! Kilobytes held in total.
+  static QAtomicInt _total_kilobytes;
+
+  //! Peak kilobytes held in total.
+  static QAtomicInt _peak_total_kilobytes;
+
+  //! Soft cap in kilobytes (0 for none).
+  static int _cap_kilobytes;
+
+  //! Apply a change in the kilobytes held against a category.
+  static void add(Category c,int kilobytes);
+};
+
+#endif
@@ -25,14 +25,25 @@
 
 #include "mutatable_image.h"
 
+#include "function_compiler.h"
+#include "function_cost.h"
 #include "function_node_info.h"
 #include "function_top.h"
 #include "mutatable_image_display_big.h"
+#include "mutation_parameters.h"
 #include "random.h"
 #include "transform.h"
 
 unsigned long long MutatableImage::_count=0;
 
+QMutex MutatableImage::_count_mutex;
+
+unsigned long long MutatableImage::next_serial()
+{
+  QMutexLocker lock(&_count_mutex);
+  return _count++;
+}
+
 MutatableImage::MutatableImage(std::auto_ptr<FunctionTop>& r,bool sinz,bool sm,bool lock)
   :
 #ifndef NDEBUG
@@ -42,9 +53,12 @@ MutatableImage::MutatableImage(std::auto_ptr<FunctionTop>& r,bool sinz,bool sm,b
   ,_sinusoidal_z(sinz)
   ,_spheremap(sm)
   ,_locked(lock)
-  ,_serial(_count++)
+  ,_serial(next_serial())
+  ,_memory(MemoryAccount::FunctionTrees)
 {
   assert(_top.get()!=0);
+  charge_memory();
+  _cost=FunctionCost::estimate(*_top);
 }
 
 MutatableImage::MutatableImage(const MutationParameters& parameters,bool exciting,bool sinz,bool sm)
@@ -55,19 +69,36 @@ MutatableImage::MutatableImage(const MutationParameters& parameters,bool excitin
   _sinusoidal_z(sinz)
   ,_spheremap(sm)
   ,_locked(false)
-  ,_serial(_count++)
+  ,_serial(next_serial())
+  ,_memory(MemoryAccount::FunctionTrees)
 {
   std::vector<real> pv;
   FunctionNode::stubparams(pv,parameters,12);
   boost::ptr_vector<FunctionNode> av;
   av.push_back(FunctionNode::stub(parameters,exciting).release());
   _top=std::auto_ptr<FunctionTop>(new FunctionTop(pv,av,0));
+  charge_memory();
+  _cost=FunctionCost::estimate(*_top);
   //! \todo _sinusoidal_z should be obtained from AnimationParameters when it exists
 }
 
 MutatableImage::~MutatableImage()
 {}
 
+/*! Node sizes vary by function class, so this is only an estimate: a bare node, its place in its parent's argument list,
+  and its parameters.
+ */
+void MutatableImage::charge_memory()
+{
+  uint nodes;
+  uint parameters;
+  uint depth;
+  uint width;
+  real proportion_constant;
+  _top->get_stats(nodes,parameters,depth,width,proportion_constant);
+  _memory.set(nodes*(sizeof(FunctionNode)+sizeof(FunctionNode*))+parameters*sizeof(real));
+}
+
 //! Accessor.
 const FunctionTop& MutatableImage::top() const
 {
@@ -85,6 +116,17 @@ boost::shared_ptr<const MutatableImage> MutatableImage::deepclone(bool lock) con
   return boost::shared_ptr<const MutatableImage>(new MutatableImage(root,sinusoidal_z(),spheremap(),lock)); 
 }
 
+boost::shared_ptr<const MutatableImage> MutatableImage::compiled(const FunctionCompiler& compiler) const
+{
+  const boost::shared_ptr<const FunctionCompiled> c(compiler.compile(top()));
+  if (!c) return boost::shared_ptr<const MutatableImage>();
+
+  std::auto_ptr<FunctionTop> root(top().typed_deepclone());
+  MutatableImage*const ret=new MutatableImage(root,sinusoidal_z(),spheremap(),locked());
+  ret->_compiled=c;
+  return boost::shared_ptr<const MutatableImage>(ret);
+}
+
 bool MutatableImage::is_constant() const
 {
   return top().is_constant();
@@ -133,11 +175,79 @@ const XYZ MutatableImage::sampling_coordinate(real x,real y,uint z,uint sx,uint
     }
 }
 
+/*! With parsimony, constant subtrees are simplified and (with that probability) the cheaper of two mutants is taken.
+  With a cost budget, mutants estimated to be over it are rejected and replaced, a few times, and if the cheapest is still over
+  its iteration counts are cut until it fits (or can't be cut any more).
+ */
 boost::shared_ptr<const MutatableImage> MutatableImage::mutated(const MutationParameters& p) const
 {
-  std::auto_ptr<FunctionTop> c(top().typed_deepclone());  
-  c->mutate(p);
-  return boost::shared_ptr<const MutatableImage>(new MutatableImage(c,sinusoidal_z(),spheremap(),false));
+  const real budget=p.cost_budget();
+  const uint candidates=((p.parsimony()>0.0 && p.r01()<p.parsimony()) ? 2 : 1);
+  const uint max_attempts=8;
+
+  std::auto_ptr<FunctionTop> best;
+  real best_cost=0.0;
+  for (uint a=0;a<max_attempts;a++)
+    {
+      if (a>=candidates && (budget==0.0 || best_cost<=budget)) break;
+
+      std::auto_ptr<FunctionTop> c(top().typed_deepclone());
+      c->mutate(p);
+      if (p.parsimony()>0.0) c->simplify_constants();
+
+      if (budget==0.0 && candidates==1)
+	{
+	  best=c;
+	  break;
+	}
+
+      const real cost=FunctionCost::estimate(*c);
+      if (!best.get() || cost<best_cost)
+	{
+	  best=c;
+	  best_cost=cost;
+	}
+    }
+
+  while (budget>0.0 && best_cost>budget && reduce_iterations(*best))
+    best_cost=FunctionCost::estimate(*best);
+
+  return boost::shared_ptr<const MutatableImage>(new MutatableImage(best,sinusoidal_z(),spheremap(),false));
+}
+
+bool MutatableImage::reduce_iterations(FunctionNode& node)
+{
+  bool reduced=false;
+  if (node._iterations>1)
+    {
+      node._iterations/=2;
+      reduced=true;
+    }
+  for (uint i=0;i<node.args().size();i++)
+    if (reduce_iterations(node.arg(i))) reduced=true;
+  return reduced;
+}
+
+bool MutatableImage::cap_iterations(FunctionNode& node,uint max)
+{
+  bool capped=false;
+  if (node._iterations>max)
+    {
+      node._iterations=max;
+      capped=true;
+    }
+  for (uint i=0;i<node.args().size();i++)
+    if (cap_iterations(node.arg(i),max)) capped=true;
+  return capped;
+}
+
+boost::shared_ptr<const MutatableImage> MutatableImage::iterations_capped(uint max) const
+{
+  if (_compiled) return boost::shared_ptr<const MutatableImage>();
+
+  std::auto_ptr<FunctionTop> c(top().typed_deepclone());
+  if (!cap_iterations(*c,max)) return boost::shared_ptr<const MutatableImage>();
+  return boost::shared_ptr<const MutatableImage>(new MutatableImage(c,sinusoidal_z(),spheremap(),locked()));
 }
 
 boost::shared_ptr<const MutatableImage> MutatableImage::simplified() const
@@ -151,13 +261,13 @@ const XYZ MutatableImage::get_rgb(const XYZ& p) const
 {
   // Actually calculate a pixel value from the image.
   // negexp distribution on colour-space parameters probably means the nominal range is something like -4.0 to 4.0
-  const XYZ pv(top()(p));
+  const XYZ pv(_compiled ? (*_compiled)(p) : top()(p));
 
   // Scale a nominal -2.0 to 2.0 range to 0-255
   return 127.5*(0.5*pv+XYZ(1.0,1.0,1.0));
 }
 
-const XYZ MutatableImage::get_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,Random01* r01,uint multisample) const
+const XYZ MutatableImage::get_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,const RandomCounter01* jitter,uint multisample) const
 {
   XYZ accumulated_colour(0.0,0.0,0.0);
   for (uint sy=0;sy<multisample;sy++)
@@ -166,8 +276,9 @@ const XYZ MutatableImage::get_rgb(uint x,uint y,uint f,uint width,uint height,ui
 	//! \todo: Multisampling in z would be a motion blur/exposure length sort of effect (but not implemented).
 	// xyz co-ords vary over -1.0 to 1.0
 	// In the one frame case z will be 0
-	const real jx=(r01 ? (*r01)() : 0.5);
-	const real jy=(r01 ? (*r01)() : 0.5);
+	const uint s=2*(sy*multisample+sx);
+	const real jx=(jitter ? (*jitter)(x,y,f,s  ) : 0.5);
+	const real jy=(jitter ? (*jitter)(x,y,f,s+1) : 0.5);
 	const XYZ p
 	  (
 	   sampling_coordinate
@@ -194,6 +305,40 @@ const XYZ MutatableImage::get_rgb(uint x,uint y,uint f,uint width,uint height,ui
   return accumulated_colour;
 }
 
+namespace
+{
+  //! Black through blue, red and yellow to white as t goes from 0 to 1.
+  const XYZ heat_colour(real t)
+  {
+    const real s=4.0*clamped(t,0.0,1.0);
+    if (s<1.0) return 255.0*XYZ(0.0,0.0,s);
+    else if (s<2.0) return 255.0*XYZ(s-1.0,0.0,2.0-s);
+    else if (s<3.0) return 255.0*XYZ(1.0,s-2.0,0.0);
+    else return 255.0*XYZ(1.0,1.0,s-3.0);
+  }
+}
+
+const XYZ MutatableImage::get_heatmap_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,const RandomCounter01* jitter,uint multisample,Heatmap heatmap) const
+{
+  const real samples=multisample*multisample;
+  if (heatmap==HeatmapEvaluations)
+    {
+      // 1 to 16384 evaluations per sample
+      const unsigned long long before=FunctionProfile::evaluations();
+      get_rgb(x,y,f,width,height,frames,jitter,multisample);
+      const real evaluations=(FunctionProfile::evaluations()-before)/samples;
+      return heat_colour(evaluations>1.0 ? log2(evaluations)/14.0 : 0.0);
+    }
+  else
+    {
+      // 64ns to 1ms per sample
+      const double start=FunctionProfile::now();
+      get_rgb(x,y,f,width,height,frames,jitter,multisample);
+      const real ns=1e9*(FunctionProfile::now()-start)/samples;
+      return heat_colour(ns>64.0 ? (log2(ns)-6.0)/14.0 : 0.0);
+    }
+}
+
 void MutatableImage::get_stats(uint& total_nodes,uint& total_parameters,uint& depth,uint& width,real& proportion_constant) const
 {
   top().get_stats(total_nodes,total_parameters,depth,width,proportion_constant);
@@ -24,8 +24,14 @@
 #ifndef _mutatable_image_h_
 #define _mutatable_image_h_
 
+#include "memory_account.h"
+
+class FunctionCompiled;
+class FunctionCompiler;
+class FunctionNode;
 class FunctionNull;
 class FunctionTop;
+class RandomCounter01;
 
 //! Class to hold the base FunctionNode of an image.
 /*! Once it owns a root FunctionNode* the whole structure should be fixed (mutate isn't available, only mutated).
@@ -37,6 +43,16 @@ class MutatableImage
 : public InstanceCounted
 #endif
 {
+ public:
+
+  //! What a heatmap (see get_heatmap_rgb) shows the cost of a pixel as.
+  enum Heatmap
+    {
+      HeatmapNone,         //!< No heatmap: normal colours.
+      HeatmapEvaluations,  //!< Function node evaluations.
+      HeatmapTime          //!< Time taken.
+    };
+
  protected:
 
   //! The top level FunctionNode of the image.
@@ -61,6 +77,30 @@ class MutatableImage
   //! Object count to generate serial numbers
   static unsigned long long _count;
 
+  //! Guards _count (images are also created by compute threads, see iterations_capped()).
+  static QMutex _count_mutex;
+
+  //! Take the next serial number.
+  static unsigned long long next_serial();
+
+  //! Native code equivalent of _top, if any (see compiled()).
+  boost::shared_ptr<const FunctionCompiled> _compiled;
+
+  //! Accounts for the tree.
+  MemoryAccount::Charge _memory;
+
+  //! Estimated seconds per sample (see FunctionCost).
+  real _cost;
+
+  //! Estimate the tree's size for _memory.
+  void charge_memory();
+
+  //! Halve the iteration counts of the iterative nodes of a tree (none below 1).  Returns false if there were none to halve.
+  static bool reduce_iterations(FunctionNode& node);
+
+  //! Limit the iteration counts of the iterative nodes of a tree.  Returns false if none were over the limit.
+  static bool cap_iterations(FunctionNode& node,uint max);
+
  public:
   
   //! Take ownership of the image tree with the specified root node.
@@ -110,6 +150,12 @@ class MutatableImage
       return _serial;
     }
 
+  //! Estimated seconds to compute a sample (one frame, no multisampling).
+  real cost() const
+    {
+      return _cost;
+    }
+
   //! Clone this image.  The cloned image will not have locked state.
   boost::shared_ptr<const MutatableImage> deepclone() const;
 
@@ -119,14 +165,34 @@ class MutatableImage
   //! Return a mutated version of this image
   boost::shared_ptr<const MutatableImage> mutated(const MutationParameters& p) const;
 
+  //! Return a version of this image with no node iterating more than max times.
+  /*! Returns null if no node does, or if the image is compiled (capping would lose the native code, costing more than it saves).
+    Safe to call from any thread.
+   */
+  boost::shared_ptr<const MutatableImage> iterations_capped(uint max) const;
+
   //! Return a simplified version of this image
   boost::shared_ptr<const MutatableImage> simplified() const;
 
+  //! Return a version of this image evaluated by native code built by the compiler.
+  /*! Returns null if the compiler couldn't produce a kernel matching the interpreter (reasons go to the compiler's log).
+   */
+  boost::shared_ptr<const MutatableImage> compiled(const FunctionCompiler& compiler) const;
+
   //! Return the a 0-255-scaled RGB value at the specified location.
   const XYZ get_rgb(const XYZ& p) const;
 
-  //! Return the a 0-255-scaled RGB value at the specified pixel of an image/animation taking jitter (if random number generator provided) and multisampling into account
-  const XYZ get_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,Random01* r01,uint multisample) const;
+  //! Return the a 0-255-scaled RGB value at the specified pixel of an image/animation taking jitter (if generator provided) and multisampling into account
+  /*! Jitter is a pure function of the generator seed, pixel, frame and subsample, so results don't depend on which thread computes the pixel.
+   */
+  const XYZ get_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,const RandomCounter01* jitter,uint multisample) const;
+
+  //! As get_rgb, but returns a colour showing what the pixel cost to compute (per sample).
+  /*! The colour scale is logarithmic and fixed (so heatmaps of different images or resolutions are comparable),
+    going from black (cheapest) through blue, red and yellow to white (most expensive).
+    Counting evaluations needs FunctionProfile counting on, and compiled images always count as none.
+   */
+  const XYZ get_heatmap_rgb(uint x,uint y,uint f,uint width,uint height,uint frames,const RandomCounter01* jitter,uint multisample,Heatmap heatmap) const;
 
   //! Return whether image value is independent of position.
   bool is_constant() const;
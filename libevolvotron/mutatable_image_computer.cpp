@@ -26,11 +26,19 @@
 #include "mutatable_image_computer.h"
 
 #include "mutatable_image.h"
+#include "mutatable_image_computer_buffer.h"
 #include "mutatable_image_computer_farm.h"
 #include "mutatable_image_computer_task.h"
+#include "mutatable_image_computer_trace.h"
 
 #include "platform_specific.h"
 
+//! Seconds a task may overrun its budget by before it's downgraded, so short tasks aren't downgraded on timing noise.
+static const double overrun_grace_seconds=0.1;
+
+//! Iterations an overrunning task's iterative nodes are cut to.
+static const uint downgrade_iterations=4;
+
 MutatableImageComputer::MutatableImageComputer(MutatableImageComputerFarm* frm,int niceness)
   :
 #ifndef NDEBUG
@@ -38,7 +46,8 @@ MutatableImageComputer::MutatableImageComputer(MutatableImageComputerFarm* frm,i
 #endif
   _farm(frm),
   _niceness(niceness),
-  _r01(23)  // Seed pretty unimportant; only used for sample jitter
+  _jitter(23),  // Seed pretty unimportant; only used for sample jitter.  Same as evolvotron_render's so images match.
+  _busy_since(-1.0)
 {
   start();
 }
@@ -51,6 +60,8 @@ MutatableImageComputer::~MutatableImageComputer()
   wait();
 
   _task.reset();
+  _batch.clear();
+  _batch_done.clear();
 
   std::clog << "...deleted a computer\n";
 }
@@ -65,52 +76,133 @@ void MutatableImageComputer::run()
   // is less important than displaying the results we've got so far.
   add_thread_niceness(_niceness);
 
+  MutatableImageComputerTrace::name_thread("Compute");
+
   // Run until something sets the kill flag 
   while(!communications().kill())
     {
-      // If we don't have a task try and get one.  This will block or return null.
+      // If we don't have a task try and get one (or a batch of small ones).  This will block or return nothing.
       if (task()==0)
 	{
-	  _task=farm()->pop_todo(*this);
+	  if (_batch.empty()) farm()->pop_todo(*this,_batch);
+	  if (!_batch.empty())
+	    {
+	      set_task(_batch.front());
+	      _batch.pop_front();
+	    }
 	}
       
       if (task())
 	{
 	  // Careful, we could be given an already aborted task
+	  uint samples=0;
 	  if (!task()->aborted())
 	    {
-	      while (!communications().kill_or_abort_or_defer() && !task()->completed())
+	      task()->buffer()->allocate();
+	      MutatableImageComputerTrace::record(MutatableImageComputerTrace::Start,*task());
+	      {
+		QMutexLocker lock(&_stats_mutex);
+		_busy_since=FunctionProfile::now();
+	      }
+
+	      // Heatmaps show what things really cost, so are never downgraded.
+	      const double budget=(task()->heatmap()==MutatableImage::HeatmapNone ? farm()->task_budget() : 0.0);
+	      double checkpoint=FunctionProfile::now();
+	      uint samples_since_checkpoint=0;
+
+	      // Deferral only happens at the start of a row, so the task resumes cleanly from where it stopped.
+	      while (!communications().kill_or_abort_or_defer(task()->current_col()==0) && !task()->completed() && !task()->aborted() && !task()->redundant())
 		{
-		  XYZ accumulated_colour=task()->image_function()->get_rgb
+		  // Write straight into the shared destination; this fragment's rows are ours alone.
+		  QRgb*const row=task()->buffer()->row
 		    (
-		     task()->fragment_origin().width()+task()->current_col(),
-		     task()->fragment_origin().height()+task()->current_row(),
 		     task()->current_frame(),
-		     task()->whole_image_size().width(),
-		     task()->whole_image_size().height(),
-		     task()->frames(),
-		     (task()->jittered_samples() ? &_r01 : 0),
-		     task()->multisample_grid()
+		     task()->fragment_origin().height()+task()->current_row()
 		     );
 
-		  const uint col0=lrint(accumulated_colour.x());
-		  const uint col1=lrint(accumulated_colour.y());
-		  const uint col2=lrint(accumulated_colour.z());
+		  // A downgraded task computes one pixel of each block and copies it to the rest (the block's origin comes first, so is done already).
+		  const int block=task()->downgrade();
+		  const int block_row=task()->current_row()-task()->current_row()%block;
+		  const int block_col=task()->current_col()-task()->current_col()%block;
+		  if (block_row!=task()->current_row() || block_col!=task()->current_col())
+		    {
+		      row[task()->fragment_origin().width()+task()->current_col()]=task()->buffer()->row
+			(
+			 task()->current_frame(),
+			 task()->fragment_origin().height()+block_row
+			 )[task()->fragment_origin().width()+block_col];
+		    }
+		  else
+		    {
+		      const XYZ accumulated_colour
+			(
+			 task()->heatmap()==MutatableImage::HeatmapNone
+			 ?
+			 task()->computed_image_function()->get_rgb
+			 (
+			  task()->fragment_origin().width()+task()->current_col(),
+			  task()->fragment_origin().height()+task()->current_row(),
+			  task()->current_frame(),
+			  task()->whole_image_size().width(),
+			  task()->whole_image_size().height(),
+			  task()->frames(),
+			  (task()->jittered_samples() ? &_jitter : 0),
+			  task()->computed_multisample_grid()
+			  )
+			 :
+			 task()->image_function()->get_heatmap_rgb
+			 (
+			  task()->fragment_origin().width()+task()->current_col(),
+			  task()->fragment_origin().height()+task()->current_row(),
+			  task()->current_frame(),
+			  task()->whole_image_size().width(),
+			  task()->whole_image_size().height(),
+			  task()->frames(),
+			  (task()->jittered_samples() ? &_jitter : 0),
+			  task()->multisample_grid(),
+			  task()->heatmap()
+			  )
+			 );
+
+		      const uint col0=lrint(accumulated_colour.x());
+		      const uint col1=lrint(accumulated_colour.y());
+		      const uint col2=lrint(accumulated_colour.z());
 
-		  task()->images()[task()->current_frame()].setPixel(task()->current_col(),task()->current_row(),((col0<<16)|(col1<<8)|(col2)));
+		      row[task()->fragment_origin().width()+task()->current_col()]=qRgb(col0,col1,col2);
+		      samples+=task()->computed_multisample_grid()*task()->computed_multisample_grid();
+		    }
 
 		  task()->pixel_advance();
+
+		  // The budget is for the samples the task was asked for, so copied pixels earn their share too.
+		  if (budget>0.0)
+		    {
+		      samples_since_checkpoint+=task()->multisample_grid()*task()->multisample_grid();
+		      const double now=FunctionProfile::now();
+		      if (now-checkpoint>overrun_grace_seconds+budget*samples_since_checkpoint)
+			{
+			  downgrade();
+			  checkpoint=now;
+			  samples_since_checkpoint=0;
+			}
+		    }
 		}
 	    }
 	  
 	  // Maybe should capture copies of the flags for use here
 	  if (!communications().kill())
 	    {
-	      if (communications().defer() && !communications().abort())
+	      if (communications().defer() && !communications().abort() && !task()->completed())
 		{
-		  farm()->push_todo(task());
+		  MutatableImageComputerTrace::record(MutatableImageComputerTrace::Defer,*task());
+		  stats_end(samples,false,false,true);
+
+		  // The rest of the batch makes way too
+		  _batch.push_front(task());
+		  farm()->push_deferred(_batch);
+		  _batch.clear();
 		  communications().defer(false);
-		  _task.reset();
+		  set_task(boost::shared_ptr<MutatableImageComputerTask>());
 		}
 	      else
 		{
@@ -122,40 +214,100 @@ void MutatableImageComputer::run()
 		  communications().defer(false);
 		  communications().abort(false);
 
-		  farm()->push_done(task());	  
-		  _task.reset();
+		  MutatableImageComputerTrace::record(task()->aborted() ? MutatableImageComputerTrace::Abort : MutatableImageComputerTrace::Complete,*task());
+		  stats_end(samples,task()->completed(),task()->aborted(),false);
+
+		  // Nobody wants aborted tasks back, so don't bother the GUI with them.
+		  if (!task()->aborted())
+		    {
+		      _batch_done.push_back(task());
+		    }
+		  set_task(boost::shared_ptr<MutatableImageComputerTask>());
 		}
 	    }
+
+	  // Deliver a batch all together when it's finished (or deferred)
+	  if (!_batch_done.empty() && _batch.empty())
+	    {
+	      farm()->push_done(_batch_done);
+	      _batch_done.clear();
+	    }
 	}
     }
   std::clog << "Thread shutting down\n";
 }
 
-bool MutatableImageComputer::defer_if_less_important_than(uint pri)
+/*! The first downgrade of a task also caps the iterations of its image function,
+  since deep iteration is the usual reason a pathological mutant is so slow.
+ */
+void MutatableImageComputer::downgrade()
 {
-  const boost::shared_ptr<const MutatableImageComputerTask> task_tmp=_task;
-  if (task_tmp && task_tmp->priority()>pri)
+  const bool first=!task()->downgraded();
+  if (!task()->downgrade(first ? task()->image_function()->iterations_capped(downgrade_iterations) : boost::shared_ptr<const MutatableImage>()))
+    return;
+
+  task()->buffer()->mark_downgraded();
+  MutatableImageComputerTrace::record(MutatableImageComputerTrace::Downgrade,*task());
+  if (first)
     {
-      communications().defer(true);
-      return true;
+      QMutexLocker lock(&_stats_mutex);
+      _stats.overruns++;
     }
-  else
+}
+
+void MutatableImageComputer::stats_end(uint samples,bool completed,bool aborted,bool deferred)
+{
+  QMutexLocker lock(&_stats_mutex);
+  if (_busy_since>=0.0)
     {
-      return false;
+      _stats.busy+=FunctionProfile::now()-_busy_since;
+      _busy_since=-1.0;
     }
+  _stats.samples+=samples;
+  if (completed) _stats.completed++;
+  if (aborted) _stats.aborted++;
+  if (deferred) _stats.deferred++;
 }
 
-void MutatableImageComputer::abort()
+void MutatableImageComputer::set_task(const boost::shared_ptr<MutatableImageComputerTask>& t)
 {
-  communications().abort(true);
+  QMutexLocker lock(&_stats_mutex);
+  _task=t;
 }
 
-void MutatableImageComputer::abort_for(const MutatableImageDisplay* disp)
+const boost::shared_ptr<const MutatableImageComputerTask> MutatableImageComputer::running_task() const
 {
-  if (task()!=0 && task()->display()==disp)
-    {
-      communications().abort(true);
-    }
+  QMutexLocker lock(&_stats_mutex);
+  return _task;
+}
+
+bool MutatableImageComputer::active() const
+{
+  QMutexLocker lock(&_stats_mutex);
+  return _task;
+}
+
+const MutatableImageComputer::Stats MutatableImageComputer::stats() const
+{
+  QMutexLocker lock(&_stats_mutex);
+  Stats ret(_stats);
+  if (_busy_since>=0.0) ret.busy+=FunctionProfile::now()-_busy_since;
+  return ret;
+}
+
+void MutatableImageComputer::defer()
+{
+  communications().defer(true);
+}
+
+bool MutatableImageComputer::deferring() const
+{
+  return communications().defer();
+}
+
+void MutatableImageComputer::abort()
+{
+  communications().abort(true);
 }
 
 void MutatableImageComputer::kill()
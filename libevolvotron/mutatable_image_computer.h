@@ -40,6 +40,38 @@ class MutatableImageComputer : public QThread
 , public InstanceCounted
 #endif
 {
+ public:
+  //! Running totals of the work done by a compute thread.
+  struct Stats
+  {
+    Stats()
+      :busy(0.0)
+      ,samples(0)
+      ,completed(0)
+      ,aborted(0)
+      ,deferred(0)
+      ,overruns(0)
+      {}
+
+    //! Seconds spent computing tasks.
+    double busy;
+
+    //! Samples computed.
+    unsigned long long samples;
+
+    //! Tasks completed.
+    unsigned long long completed;
+
+    //! Tasks abandoned part way (or before starting) because they were aborted.
+    unsigned long long aborted;
+
+    //! Times a task was deferred to make way for another.
+    unsigned long long deferred;
+
+    //! Tasks downgraded for overrunning the farm's task budget.
+    unsigned long long overruns;
+  };
+
  protected:
   //! Pointer to compute farm of which this thread is part.
   MutatableImageComputerFarm*const _farm;
@@ -48,10 +80,20 @@ class MutatableImageComputer : public QThread
   const int _niceness;
 
   //! The current task.  Can't be a const MutatableImageComputerTask because the task holds the calculated result.
+  /*! Only assigned by the compute thread (see set_task), which can read it freely; other threads read it under _stats_mutex.
+   */
   boost::shared_ptr<MutatableImageComputerTask> _task;
 
-  //! Randomness for sampling jitter
-  Random01 _r01;
+  //! Tasks taken from the farm along with the current one and still to be computed (small tasks are taken in batches).
+  std::deque<boost::shared_ptr<MutatableImageComputerTask> > _batch;
+
+  //! Tasks completed from the current batch, returned to the farm together when it's finished.
+  std::vector<boost::shared_ptr<MutatableImageComputerTask> > _batch_done;
+
+  //! Randomness for sampling jitter.
+  /*! Counter-based, so jitter is the same whichever computer renders a pixel.
+   */
+  const RandomCounter01 _jitter;
 
   //! Class encapsulating mutex-protected flags used for communicating between farm and worker.
   /*! The Mutex is of dubious value (could certainly be eliminated for reads).
@@ -128,16 +170,36 @@ class MutatableImageComputer : public QThread
 	  return ret;
 	}
       //! Check union of all flags with only one mutex lock.
-      bool kill_or_abort_or_defer() const
+      /*! The defer flag is only honoured at a point the task can be deferred at.
+       */
+      bool kill_or_abort_or_defer(bool deferrable) const
 	{
 	  QMutexLocker lock(&_mutex);
-	  const bool ret=(_kill || _abort || _defer);
+	  const bool ret=(_kill || _abort || (_defer && deferrable));
 	  return ret;
 	}
     };
 
   //! Instance of communications flags.
   Communications _communications;
+
+  //! Protects _stats, _busy_since and _task.  Only taken at the start and end of a task, on a downgrade, and by stats() and running_task().
+  mutable QMutex _stats_mutex;
+
+  //! Totals so far (not including the task in progress).
+  Stats _stats;
+
+  //! When computing of the current task started (negative if not computing).
+  double _busy_since;
+
+  //! Change the current task (null for none).  Compute thread only.
+  void set_task(const boost::shared_ptr<MutatableImageComputerTask>& t);
+
+  //! Make the rest of the current task cheaper, because it's overrun the farm's task budget.
+  void downgrade();
+
+  //! Account for the end of a stint computing the current task.
+  void stats_end(uint samples,bool completed,bool aborted,bool deferred);
   
   //! The actual compute code, launched by invoking start() in the constructor.
   virtual void run();
@@ -173,15 +235,21 @@ class MutatableImageComputer : public QThread
   //! Destructor
   ~MutatableImageComputer();
 
-  //! Defer the current task if it's priority is less important than specified.  Returns true if deferrment occurred.
-  bool defer_if_less_important_than(uint pri);
+  //! Ask the thread to put its current task back on the todo queue (at the next row boundary) and take another.
+  void defer();
+
+  //! Whether a defer has been requested and not yet acted on.
+  bool deferring() const;
+
+  //! The task being computed (null if none).  Only a snapshot: the thread may move on to another at any time.
+  const boost::shared_ptr<const MutatableImageComputerTask> running_task() const;
+
+  //! Totals so far, including the time spent on the task in progress.  Can be called from any thread.
+  const Stats stats() const;
 
   //! This method called by an external threads to shut down the current task
   void abort();
 
-  //! This method called by an external threads to shut down the current task if it's for a particular display
-  void abort_for(const MutatableImageDisplay* disp);
-
   //! This method called by external thread to kill the thread.
   void kill();
 
@@ -191,10 +259,7 @@ class MutatableImageComputer : public QThread
   bool killed() const;
 
   //! Indicate whether computation us taking place (only intended for counting outstanding threads).
-  bool active() const
-    {
-      return _task;
-    }
+  bool active() const;
 };
 
 #endif
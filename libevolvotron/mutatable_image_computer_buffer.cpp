@@ -0,0 +1,118 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class MutatableImageComputerBuffer.
+*/
+
+#include "libevolvotron_precompiled.h"
+
+#include "mutatable_image_computer_buffer.h"
+
+MutatableImageComputerBuffer::MutatableImageComputerBuffer(const QSize& size,uint frames,uint fragments,const QSize& display_size,const QSize& icon_size)
+  :
+#ifndef NDEBUG
+  InstanceCounted(typeid(this).name(),false),
+#endif
+  _size(size)
+  ,_frames(frames)
+  ,_display_size(display_size)
+  ,_icon_size(icon_size)
+  ,_fragments_remaining(fragments)
+  ,_fragment_done(fragments)
+  ,_completed(0)
+  ,_downgraded(0)
+  ,_bytes_per_line(0)
+  ,_memory(MemoryAccount::RenderBuffers)
+{
+  assert(fragments>=1);
+}
+
+MutatableImageComputerBuffer::~MutatableImageComputerBuffer()
+{}
+
+void MutatableImageComputerBuffer::allocate()
+{
+  QMutexLocker lock(&_mutex);
+  if (_images.empty())
+    {
+      _images.reserve(_frames);
+      for (uint f=0;f<_frames;f++)
+	{
+	  _images.push_back(QImage(_size,QImage::Format_RGB32));
+	  _bits.push_back(_images.back().bits());
+	}
+      _bytes_per_line=_images.front().bytesPerLine();
+      charge_memory();
+    }
+}
+
+void MutatableImageComputerBuffer::seed(const std::vector<QImage>& images)
+{
+  QMutexLocker lock(&_mutex);
+  assert(_images.empty());
+  assert(images.size()==_frames);
+  _images.reserve(_frames);
+  for (uint f=0;f<_frames;f++)
+    {
+      assert(images[f].size()==_size);
+      // Deep copy, so writing into it can't disturb anyone else's images.
+      _images.push_back(images[f].copy());
+      _bits.push_back(_images.back().bits());
+    }
+  _bytes_per_line=_images.front().bytesPerLine();
+  charge_memory();
+}
+
+bool MutatableImageComputerBuffer::fragment_completed(uint fragment)
+{
+  assert(fragment<_fragment_done.size());
+  if (!_fragment_done[fragment].testAndSetOrdered(0,1))
+    return false;
+
+  if (_fragments_remaining.fetchAndAddOrdered(-1)!=1)
+    return false;
+
+  // Last fragment: nothing else writes the images now, so post-process them here in the compute thread.
+  _display_images.reserve(_frames);
+  for (uint f=0;f<_frames;f++)
+    {
+      //! \todo Pick a scaling mode: Qt::SmoothTransformation vs Qt::FastTransformation (default) (and put it under GUI control). 
+      _display_images.push_back(_display_size==_size ? _images[f] : _images[f].scaled(_display_size));
+    }
+  if (!_icon_size.isNull())
+    _icon_image=_images[_frames/2].scaled(_icon_size);
+  charge_memory();
+
+  _completed.fetchAndStoreOrdered(1);
+  return true;
+}
+
+/*! Display images the same size as the rendered ones share their data, so aren't counted again.
+ */
+void MutatableImageComputerBuffer::charge_memory()
+{
+  size_t bytes=_icon_image.byteCount();
+  for (uint f=0;f<_images.size();f++)
+    bytes+=_images[f].byteCount();
+  if (_display_size!=_size)
+    for (uint f=0;f<_display_images.size();f++)
+      bytes+=_display_images[f].byteCount();
+  _memory.set(bytes);
+}
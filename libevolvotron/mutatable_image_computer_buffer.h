@@ -0,0 +1,198 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file 
+  \brief Interface for class MutatableImageComputerBuffer.
+*/
+
+#ifndef _mutatable_image_computer_buffer_h_
+#define _mutatable_image_computer_buffer_h_
+
+#include "memory_account.h"
+
+//! Destination for the pixels of all the fragment tasks making up one (level,multisample) rendering of an image.
+/*! Tasks write straight into the images by row pointer; fragments cover disjoint areas so no locking is needed.
+  Fragments are usually strips of rows, but tiles work just as well.
+  Each completed fragment decrements a counter, and once that reaches zero the images are complete
+  and the display can use them as they are, with no staging area or assembling copy.
+  The images are allocated by the first task to run, so queued high resolution levels don't all hold memory at once.
+  The compute thread completing the last fragment also does the post-processing the display needs
+  (scaling to the display's size, and an icon), so all the GUI thread has left to do is swap images and repaint.
+ */
+class MutatableImageComputerBuffer
+#ifndef NDEBUG
+: public InstanceCounted
+#endif
+{
+ public:
+  //! Constructor.
+  /*! Images are rendered at size, and scaled to display_size when complete.
+    A null icon_size means no icon is wanted.
+   */
+  MutatableImageComputerBuffer(const QSize& size,uint frames,uint fragments,const QSize& display_size,const QSize& icon_size);
+
+  //! Destructor.
+  ~MutatableImageComputerBuffer();
+
+  //! Accessor.
+  const QSize& size() const
+    {
+      return _size;
+    }
+
+  //! Accessor.
+  uint frames() const
+    {
+      return _frames;
+    }
+
+  //! Number of fragments the images are rendered in.
+  uint fragments() const
+    {
+      return _fragment_done.size();
+    }
+
+  //! Make sure the images exist.  Called by each task before it writes anything; cheap after the first time.
+  void allocate();
+
+  //! Allocate the images as copies of existing ones (of the same size), when only some areas need computing.
+  /*! Must be called before any task for the buffer is queued.
+   */
+  void seed(const std::vector<QImage>& images);
+
+  //! Start of a row of a frame, for writing.  Only valid after allocate().
+  QRgb* row(uint frame,int y) const
+    {
+      assert(frame<_frames);
+      assert(0<=y && y<_size.height());
+      return reinterpret_cast<QRgb*>(_bits[frame]+y*_bytes_per_line);
+    }
+
+  //! Note completion of a fragment.  The last one also does the post-processing, and returns true.
+  /*! Completing a fragment more than once (a retiled task racing its replacement) only counts the first time.
+   */
+  bool fragment_completed(uint fragment);
+
+  //! Whether a fragment has been completed.  Its pixels can then be read, even while other fragments are still being written.
+  bool fragment_done(uint fragment) const
+    {
+      assert(fragment<_fragment_done.size());
+      return (_fragment_done[fragment]==1);
+    }
+
+  //! Whether all fragments have been completed and post-processed.
+  bool completed() const
+    {
+      return (_completed==1);
+    }
+
+  //! Note that some fragment was downgraded (computed coarser or with fewer samples) because it overran its time budget.
+  void mark_downgraded()
+    {
+      _downgraded.fetchAndStoreOrdered(1);
+    }
+
+  //! Whether any fragment was downgraded.
+  bool downgraded() const
+    {
+      return (_downgraded==1);
+    }
+
+  //! The rendered images.  Only meaningful once completed.
+  const std::vector<QImage>& images() const
+    {
+      assert(completed());
+      return _images;
+    }
+
+  //! The images as rendered so far, before completion.
+  /*! Only valid once some fragment is done, and only the pixels of done fragments may be read (with const methods only).
+   */
+  const std::vector<QImage>& partial_images() const
+    {
+      return _images;
+    }
+
+  //! The rendered images scaled to the display size.  Only meaningful once completed.
+  const std::vector<QImage>& display_images() const
+    {
+      assert(completed());
+      return _display_images;
+    }
+
+  //! Icon image (null if none was asked for).  Only meaningful once completed.
+  const QImage& icon_image() const
+    {
+      assert(completed());
+      return _icon_image;
+    }
+
+ private:
+  //! Size of each image.
+  const QSize _size;
+
+  //! Number of animation frames.
+  const uint _frames;
+
+  //! Size the images are to be displayed at.
+  const QSize _display_size;
+
+  //! Size of icon wanted.
+  const QSize _icon_size;
+
+  //! Count of fragments still to be completed.
+  QAtomicInt _fragments_remaining;
+
+  //! Set (to 1) for each fragment once completed.
+  std::vector<QAtomicInt> _fragment_done;
+
+  //! Set (to 1) once the images are complete and post-processed.
+  QAtomicInt _completed;
+
+  //! Set (to 1) if any fragment was downgraded.
+  QAtomicInt _downgraded;
+
+  //! Guards allocation of the images.
+  QMutex _mutex;
+
+  //! The images, one per frame.
+  std::vector<QImage> _images;
+
+  //! Start of each image's pixel data.
+  /*! Obtained once at allocation, so writers never call (potentially detaching) non-const QImage methods.
+   */
+  std::vector<uchar*> _bits;
+
+  //! Stride of the image data.
+  int _bytes_per_line;
+
+  //! Post-processed images for display.
+  std::vector<QImage> _display_images;
+
+  //! Post-processed icon.
+  QImage _icon_image;
+
+  //! Accounts for the images.
+  MemoryAccount::Charge _memory;
+
+  //! Update _memory from the images held.
+  void charge_memory();
+};
+
+#endif
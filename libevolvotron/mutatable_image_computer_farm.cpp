@@ -26,12 +26,28 @@
 #include "mutatable_image_computer_farm.h"
 
 #include "mutatable_image_computer.h"
+#include "mutatable_image_computer_trace.h"
 
 /*! Creates the specified number of threads and store pointers to them.
  */
-MutatableImageComputerFarm::MutatableImageComputerFarm(uint n_threads,int niceness)
+MutatableImageComputerFarm::MutatableImageComputerFarm(uint n_threads,int niceness,QObject* done_receiver)
+  :_lock_wait(0.0)
+  ,_lock_taken(0)
+  ,_lock_contended(0)
+  ,_done_incoming(0)
+  ,_done_receiver(done_receiver)
+  ,_dropped_todo(0)
+  ,_dropped_done(0)
+  ,_first_pixels_count(0)
+  ,_first_pixels_total(0)
+  ,_task_budget_ns(0)
 {
   _done_position=_done.end();
+
+  _share[0]=3;
+  _share[1]=1;
+  _charged[0]=0.0;
+  _charged[1]=0.0;
   
   for (uint i=0;i<n_threads;i++)
     {
@@ -54,74 +70,212 @@ MutatableImageComputerFarm::~MutatableImageComputerFarm()
 
   // Clear all the tasks in queues
   {
-    QMutexLocker lock(&_mutex);    
-    _todo.clear();
+    Lock lock(*this);
+    _todo[0].clear();
+    _todo[1].clear();
     _done.clear();
   }
 
+  // No compute threads left to push anything now
+  DoneNode* node=_done_incoming.fetchAndStoreOrdered(0);
+  while (node)
+    {
+      DoneNode*const next=node->next;
+      delete node;
+      node=next;
+    }
+
   std::clog << "...completed compute farm shut down\n";
 }
 
-//! Predicate function to test whether a task has been aborted
-static bool predicate_aborted(const boost::shared_ptr<const MutatableImageComputerTask> t) 
+/*! Only measures the clock when the mutex is found held, so uncontended locking costs no more than before.
+ */
+void MutatableImageComputerFarm::lock() const
 {
-  return t->aborted();
+  if (!_mutex.tryLock())
+    {
+      const double start=FunctionProfile::now();
+      _mutex.lock();
+      _lock_wait+=FunctionProfile::now()-start;
+      _lock_contended++;
+    }
+  _lock_taken++;
 }
 
-void MutatableImageComputerFarm::fasttrack_aborted()
+void MutatableImageComputerFarm::shares(uint grid,uint enlargement)
 {
-  QMutexLocker lock(&_mutex);
-  
-  // \todo: Inefficient starting search again each time.  Some problem with erase otherwise though, but might have been task abort mem leak.
-  TodoQueue::iterator it;
-  while (
-	 (
-	  it=std::find_if(_todo.begin(),_todo.end(),predicate_aborted)
-	  )
-	 !=
-	 _todo.end()
-	 )
+  Lock lock(*this);
+  _share[0]=std::max(1u,grid);
+  _share[1]=std::max(1u,enlargement);
+}
+
+void MutatableImageComputerFarm::task_budget(double seconds)
+{
+  _task_budget_ns.fetchAndStoreOrdered(lrint(1e9*std::max(0.0,seconds)));
+}
+
+double MutatableImageComputerFarm::task_budget() const
+{
+  return 1e-9*static_cast<int>(_task_budget_ns);
+}
+
+/*! Within a class, a task preempts less important ones only if there are no workers free for it.
+  Across classes, a class running on fewer than its share of the threads can take them from the other,
+  whatever the priorities (otherwise enlargements, with their huge sample counts, would never get a look in).
+ */
+void MutatableImageComputerFarm::preempt_for(const MutatableImageComputerTask& task)
+{
+  const uint c=task.enlargement();
+
+  // Workers which are idle, or already making way, will get to it anyway.
+  uint available=0;
+  uint running[2]={0,0};
+  for (boost::ptr_vector<MutatableImageComputer>::iterator it=_computers.begin();it!=_computers.end();it++)
+    {
+      const boost::shared_ptr<const MutatableImageComputerTask> r=(*it).running_task();
+      if (!r || (*it).deferring())
+	available++;
+      else
+	running[r->enlargement()]++;
+    }
+
+  const bool under_share=(running[c]*(_share[0]+_share[1])<_share[c]*_computers.size());
+
+  // Sorted on other class first, then least important first.
+  typedef std::pair<std::pair<bool,uint>,MutatableImageComputer*> Preemptable;
+  std::vector<Preemptable> preemptable;
+  for (boost::ptr_vector<MutatableImageComputer>::iterator it=_computers.begin();it!=_computers.end();it++)
     {
-      _done[(*it)->display()].insert(*it);
-      _todo.erase(it);
-    }  
+      const boost::shared_ptr<const MutatableImageComputerTask> r=(*it).running_task();
+      if (r && !(*it).deferring())
+	{
+	  const bool other=(r->enlargement()!=task.enlargement());
+	  if (other ? under_share : r->priority()>task.priority())
+	    preemptable.push_back(Preemptable(std::make_pair(other,r->priority()),&(*it)));
+	}
+    }
+
+  // Workers wanted for this task and any queued ones it won't get ahead of (no need to count beyond what we could supply).
+  uint wanted=1;
+  for (TodoQueue::const_iterator it=_todo[c].begin();it!=_todo[c].end() && (*it)->priority()<=task.priority() && wanted<=available;it++)
+    wanted++;
+
+  if (wanted>available)
+    {
+      std::sort(preemptable.begin(),preemptable.end(),std::greater<Preemptable>());
+      for (uint i=0;i<wanted-available && i<preemptable.size();i++)
+	preemptable[i].second->defer();
+    }
+}
+
+int MutatableImageComputerFarm::next_class() const
+{
+  if (_todo[0].empty()) return (_todo[1].empty() ? -1 : 1);
+  if (_todo[1].empty()) return 0;
+  return (_charged[1]<_charged[0] ? 1 : 0);
+}
+
+void MutatableImageComputerFarm::charge(uint c,uint samples)
+{
+  _charged[c]+=static_cast<double>(samples)/_share[c];
+
+  const uint other=1-c;
+  if (_todo[other].empty()) _charged[other]=std::max(_charged[other],_charged[c]);
 }
 
 void MutatableImageComputerFarm::push_todo(const boost::shared_ptr<MutatableImageComputerTask>& task)
 {
   {
-    QMutexLocker lock(&_mutex);
+    Lock lock(*this);
 
     // We could be in a situation where there are tasks with lower priority which should be defered in favour of this one.
-    // Currently we simply defer everything with a lower priority and let the queue sort them out.
-    //! \todo: It would be better to just defer the lowest priority task if there's any less than the queued task.
-    bool any_deferred=false;
-    for (boost::ptr_vector<MutatableImageComputer>::iterator it=_computers.begin();it!=_computers.end();it++)
-      {
-	if ((*it).defer_if_less_important_than(task->priority()))
-	  {
-	    any_deferred=true;
-	  }
-      }
+    preempt_for(*task);
 
-    _todo.insert(task);
+    _todo[task->enlargement()].insert(task);
+    MutatableImageComputerTrace::record(MutatableImageComputerTrace::Enqueue,*task);
   }
 
   // If there any threads waiting, we should wake one up.
   _wait_condition.wakeOne();
 }
 
-const boost::shared_ptr<MutatableImageComputerTask> MutatableImageComputerFarm::pop_todo(MutatableImageComputer& requester)
+void MutatableImageComputerFarm::push_todo(const std::vector<boost::shared_ptr<MutatableImageComputerTask> >& tasks)
 {
-  _mutex.lock();
-  boost::shared_ptr<MutatableImageComputerTask> ret;
-  while (!ret)
+  {
+    Lock lock(*this);
+
+    for (std::vector<boost::shared_ptr<MutatableImageComputerTask> >::const_iterator it=tasks.begin();it!=tasks.end();it++)
+      {
+	preempt_for(**it);
+	_todo[(*it)->enlargement()].insert(*it);
+	MutatableImageComputerTrace::record(MutatableImageComputerTrace::Enqueue,**it);
+      }
+  }
+
+  // Plenty for everyone
+  if (tasks.size()>1)
+    _wait_condition.wakeAll();
+  else
+    _wait_condition.wakeOne();
+}
+
+void MutatableImageComputerFarm::push_deferred(const std::deque<boost::shared_ptr<MutatableImageComputerTask> >& tasks)
+{
+  {
+    Lock lock(*this);
+    for (std::deque<boost::shared_ptr<MutatableImageComputerTask> >::const_iterator it=tasks.begin();it!=tasks.end();it++)
+      _todo[(*it)->enlargement()].insert(*it);
+  }
+  _wait_condition.wakeOne();
+}
+
+/*! Tasks small enough to be cheaper to compute than to queue and deliver individually
+  (the low resolution levels of a respawned grid) are taken in batches from the head of the queue.
+  Being low resolution first, the head of the queue is where they all are.
+ */
+void MutatableImageComputerFarm::pop_todo(MutatableImageComputer& requester,std::deque<boost::shared_ptr<MutatableImageComputerTask> >& batch)
+{
+  // Tasks for images with no more (cost weighted) samples than this are batched...
+  const uint batch_priority=64*64;
+  // ...up to this many samples in total.
+  const uint batch_samples=64*64*4;
+
+  // Aborted tasks are only ever dropped here (or in pop_done), never searched for.
+  // They're released after unlocking, so freeing them doesn't hold up the other threads.
+  std::vector<boost::shared_ptr<MutatableImageComputerTask> > aborted;
+
+  lock();
+  uint samples=0;
+  while (batch.empty() || (samples<batch_samples && batch.back()->priority()<=batch_priority))
     {
-      TodoQueue::iterator it=_todo.begin();
-      if (it!=_todo.end())
+      // Batches are all of one class.
+      const int c=(batch.empty() ? next_class() : batch.front()->enlargement());
+      if (c!=-1 && !_todo[c].empty())
 	{
-	  ret=(*it);
-	  _todo.erase(it);
+	  TodoQueue::iterator it=_todo[c].begin();
+	  if (!batch.empty() && (*it)->priority()>batch_priority)
+	    break;
+
+	  const boost::shared_ptr<MutatableImageComputerTask> task(*it);
+	  _todo[c].erase(it);
+
+	  if (task->aborted())
+	    {
+	      MutatableImageComputerTrace::record(MutatableImageComputerTrace::Abort,*task);
+	      aborted.push_back(task);
+	      _dropped_todo++;
+	    }
+	  else
+	    {
+	      MutatableImageComputerTrace::record(MutatableImageComputerTrace::Pop,*task);
+	      batch.push_back(task);
+	      samples+=task->samples();
+	      charge(c,task->samples());
+	    }
+	}
+      else if (!batch.empty())
+	{
+	  break;
 	}
       else
 	{
@@ -132,18 +286,88 @@ const boost::shared_ptr<MutatableImageComputerTask> MutatableImageComputerFarm::
 	}
     }
   _mutex.unlock();
-  return ret;
 }
 
-void MutatableImageComputerFarm::push_done(const boost::shared_ptr<MutatableImageComputerTask>& task)
+/*! Compute threads never block here: the tasks go on a lock-free stack in one go.
+  Only a push on to an empty stack wakes the GUI thread; later pushes are picked up by the same
+  wakeup, so a burst of small completions costs the event loop a single event.
+ */
+void MutatableImageComputerFarm::push_done(const std::vector<boost::shared_ptr<MutatableImageComputerTask> >& tasks)
+{
+  if (tasks.empty()) return;
+
+  // Chain them up most recent first, as if pushed one at a time
+  DoneNode*const last=new DoneNode;
+  last->task=tasks.front();
+  last->next=0;
+  DoneNode* first=last;
+  for (uint i=1;i<tasks.size();i++)
+    {
+      DoneNode*const node=new DoneNode;
+      node->task=tasks[i];
+      node->next=first;
+      first=node;
+    }
+
+  // Counted before publishing, or the GUI thread could take them and uncount them first (taking the count below zero).
+  for (uint i=0;i<tasks.size();i++)
+    _done_incoming_count[tasks[i]->enlargement()].ref();
+
+  DoneNode* head;
+  do
+    {
+      head=_done_incoming;
+      last->next=head;
+    }
+  while (!_done_incoming.testAndSetOrdered(head,first));
+
+  if (!head && _done_receiver)
+    {
+      QMetaObject::invokeMethod(_done_receiver,"tasks_done",Qt::QueuedConnection);
+    }
+}
+
+void MutatableImageComputerFarm::take_done_incoming()
 {
-  QMutexLocker lock(&_mutex);
-  _done[task->display()].insert(task);
+  // Reverse the stack as it's unlinked so tasks are queued in order of completion
+  DoneNode* node=_done_incoming.fetchAndStoreOrdered(0);
+  DoneNode* fifo=0;
+  while (node)
+    {
+      DoneNode*const next=node->next;
+      node->next=fifo;
+      fifo=node;
+      node=next;
+    }
+
+  while (fifo)
+    {
+      DoneNode*const next=fifo->next;
+      _done[fifo->task->display()].insert(fifo->task);
+      _done_incoming_count[fifo->task->enlargement()].deref();
+      delete fifo;
+      fifo=next;
+    }
 }
 
 const boost::shared_ptr<MutatableImageComputerTask> MutatableImageComputerFarm::pop_done()
 {
-  QMutexLocker lock(&_mutex); 
+  boost::shared_ptr<MutatableImageComputerTask> ret;
+  do
+    {
+      ret=pop_done_any();
+      if (ret && ret->aborted()) _dropped_done++;
+    }
+  while (ret && ret->aborted());
+  return ret;
+}
+
+const boost::shared_ptr<MutatableImageComputerTask> MutatableImageComputerFarm::pop_done_any()
+{
+  if (_done_position==_done.end() || _done.empty())
+    {
+      take_done_incoming();
+    }
 
   boost::shared_ptr<MutatableImageComputerTask> ret;  
   if (_done_position==_done.end())
@@ -179,13 +403,17 @@ const boost::shared_ptr<MutatableImageComputerTask> MutatableImageComputerFarm::
 
 void MutatableImageComputerFarm::abort_all()
 {
-  QMutexLocker lock(&_mutex); 
+  Lock lock(*this);
 
-  for (TodoQueue::iterator it=_todo.begin();it!=_todo.end();it++)
+  for (uint c=0;c<2;c++)
     {
-      (*it)->abort();
+      for (TodoQueue::iterator it=_todo[c].begin();it!=_todo[c].end();it++)
+	{
+	  (*it)->abort();
+	}
+      _dropped_todo+=_todo[c].size();
+      _todo[c].clear();
     }
-  _todo.clear();
 
   for (boost::ptr_vector<MutatableImageComputer>::iterator it=_computers.begin();it!=_computers.end();it++)
     {
@@ -199,63 +427,287 @@ void MutatableImageComputerFarm::abort_all()
 	{
 	  (*it1)->abort();
 	}
+      _dropped_done+=q.size();
     }
   _done.clear();
 }
 
-void MutatableImageComputerFarm::abort_for(const MutatableImageDisplay* disp)
-{
-  QMutexLocker lock(&_mutex); 
-
-  for (TodoQueue::iterator it=_todo.begin();it!=_todo.end();it++)
-    {
-      if ((*it)->display()==disp)
-	{
-	  (*it)->abort();
-	  _todo.erase(it);
-	}
-    }
-  
-  for (boost::ptr_vector<MutatableImageComputer>::iterator it=_computers.begin();it!=_computers.end();it++)
-    {      
-      (*it).abort_for(disp);
-    }
-  
-  DoneQueueByDisplay::iterator it0=_done.find(disp);
-  if (it0!=_done.end())
-    {
-      DoneQueue& q=(*it0).second;
-
-      //! \todo It would be pretty odd if display didn't match the queue bin: change to assert
-      for (DoneQueue::iterator it1=q.begin();it1!=q.end();it1++)
-	{
-	  if ((*it1)->display()==disp)
-	    {
-	      (*it1)->abort();
-	      q.erase(it1);
-	    }
-	}
-    }
-}
-
-uint MutatableImageComputerFarm::tasks() const
+uint MutatableImageComputerFarm::tasks(bool enlargement) const
 {
   uint ret=0;
   
   for (boost::ptr_vector<MutatableImageComputer>::const_iterator it=_computers.begin();it!=_computers.end();it++)
     {      
-      if ((*it).active())
+      const boost::shared_ptr<const MutatableImageComputerTask> r=(*it).running_task();
+      if (r && r->enlargement()==enlargement)
 	{
 	  ret++;
 	}
     }
 
-  QMutexLocker lock(&_mutex); 
+  {
+    Lock lock(*this);
+    ret+=_todo[enlargement].size();
+  }
 
-  ret+=_todo.size();
+  ret+=_done_incoming_count[enlargement];
 
+  // A display's tasks are all of one class
   for (DoneQueueByDisplay::const_iterator it=_done.begin();it!=_done.end();it++)
-    ret+=(*it).second.size();
+    if (!(*it).second.empty() && (*(*it).second.begin())->enlargement()==enlargement)
+      ret+=(*it).second.size();
+
+  return ret;
+}
+
+uint MutatableImageComputerFarm::priority_band(uint priority)
+{
+  if (priority<=64*64) return 0;
+  if (priority<=256*256) return 1;
+  return 2;
+}
 
+MutatableImageComputerFarm::Stats::Stats()
+  :time(0.0)
+  ,dropped(0)
+  ,first_pixels_count(0)
+  ,first_pixels_total(0)
+  ,lock_wait(0.0)
+  ,lock_taken(0)
+  ,lock_contended(0)
+  ,memory_peak(0)
+{
+  for (uint c=0;c<2;c++)
+    for (uint b=0;b<PriorityBands;b++)
+      queued[c][b]=0;
+  for (uint c=0;c<MemoryAccount::Categories;c++)
+    memory[c]=0;
+}
+
+const MutatableImageComputerFarm::Stats MutatableImageComputerFarm::stats() const
+{
+  Stats ret;
+  ret.time=FunctionProfile::now();
+
+  for (boost::ptr_vector<MutatableImageComputer>::const_iterator it=_computers.begin();it!=_computers.end();it++)
+    ret.threads.push_back((*it).stats());
+
+  {
+    Lock lock(*this);
+    for (uint c=0;c<2;c++)
+      for (TodoQueue::const_iterator it=_todo[c].begin();it!=_todo[c].end();it++)
+	ret.queued[c][priority_band((*it)->priority())]++;
+    ret.dropped=_dropped_todo;
+    ret.lock_wait=_lock_wait;
+    ret.lock_taken=_lock_taken;
+    ret.lock_contended=_lock_contended;
+  }
+
+  ret.dropped+=_dropped_done;
+  ret.first_pixels_count=_first_pixels_count;
+  ret.first_pixels_total=_first_pixels_total;
+  for (uint c=0;c<MemoryAccount::Categories;c++)
+    ret.memory[c]=MemoryAccount::bytes(static_cast<MemoryAccount::Category>(c));
+  ret.memory_peak=MemoryAccount::peak_total();
   return ret;
 }
+
+void MutatableImageComputerFarm::first_pixels_delivered(int ms)
+{
+  _first_pixels_count++;
+  _first_pixels_total+=ms;
+}
+
+namespace
+{
+  //! What's shared by both forms of report.
+  struct Rates
+  {
+    //! Seconds between the snapshots.
+    double interval;
+
+    //! Proportion of the interval each thread spent computing.
+    std::vector<double> busy;
+
+    //! Samples per second computed by each thread.
+    std::vector<double> samples;
+
+    //! Sum over the threads (as of the later snapshot).
+    MutatableImageComputer::Stats total;
+
+    //! Mean proportion of the interval the threads spent computing.
+    double total_busy;
+
+    //! Samples per second computed by all threads.
+    double total_samples;
+
+    //! Mean time (ms) to first pixels over the images loaded during the interval (negative if none).
+    double first_pixels;
+
+    Rates(const MutatableImageComputerFarm::Stats& before,const MutatableImageComputerFarm::Stats& after)
+      :interval(after.time-before.time)
+      ,total_busy(0.0)
+      ,total_samples(0.0)
+      ,first_pixels(-1.0)
+      {
+	for (uint i=0;i<after.threads.size();i++)
+	  {
+	    const MutatableImageComputer::Stats& a=after.threads[i];
+	    const MutatableImageComputer::Stats b=(i<before.threads.size() ? before.threads[i] : MutatableImageComputer::Stats());
+	    busy.push_back(interval>0.0 ? (a.busy-b.busy)/interval : 0.0);
+	    samples.push_back(interval>0.0 ? (a.samples-b.samples)/interval : 0.0);
+	    total_busy+=busy.back()/after.threads.size();
+	    total_samples+=samples.back();
+	    total.busy+=a.busy;
+	    total.samples+=a.samples;
+	    total.completed+=a.completed;
+	    total.aborted+=a.aborted;
+	    total.deferred+=a.deferred;
+	    total.overruns+=a.overruns;
+	  }
+	if (after.first_pixels_count>before.first_pixels_count)
+	  first_pixels=static_cast<double>(after.first_pixels_total-before.first_pixels_total)/(after.first_pixels_count-before.first_pixels_count);
+      }
+  };
+}
+
+/*! Per-thread samples are only counted when a task finishes (or is deferred or aborted),
+  so rates over short intervals are lumpy when tasks are big.
+ */
+std::ostream& MutatableImageComputerFarm::report(std::ostream& out,const Stats& before,const Stats& after)
+{
+  const Rates r(before,after);
+
+  out << std::fixed << std::setprecision(1);
+  out << "Over the last " << r.interval << "s:\n";
+  out
+    << std::setw(8) << "thread"
+    << std::setw(8) << "busy%"
+    << std::setw(12) << "samples/s"
+    << std::setw(11) << "completed"
+    << std::setw(9) << "aborted"
+    << std::setw(10) << "deferred"
+    << std::setw(9) << "overran"
+    << "\n";
+  for (uint i=0;i<after.threads.size();i++)
+    out
+      << std::setw(8) << i+1
+      << std::setw(8) << 100.0*r.busy[i]
+      << std::setw(12) << std::setprecision(0) << r.samples[i] << std::setprecision(1)
+      << std::setw(11) << after.threads[i].completed
+      << std::setw(9) << after.threads[i].aborted
+      << std::setw(10) << after.threads[i].deferred
+      << std::setw(9) << after.threads[i].overruns
+      << "\n";
+  out
+    << std::setw(8) << "all"
+    << std::setw(8) << 100.0*r.total_busy
+    << std::setw(12) << std::setprecision(0) << r.total_samples << std::setprecision(1)
+    << std::setw(11) << r.total.completed
+    << std::setw(9) << r.total.aborted
+    << std::setw(10) << r.total.deferred
+    << std::setw(9) << r.total.overruns
+    << "\n\n";
+
+  out
+    << std::setw(14) << "queued"
+    << std::setw(10) << "<=64^2"
+    << std::setw(10) << "<=256^2"
+    << std::setw(10) << "larger"
+    << "  (samples)\n";
+  for (uint c=0;c<2;c++)
+    {
+      out << std::setw(14) << (c ? "enlargement" : "grid");
+      for (uint b=0;b<PriorityBands;b++)
+	out << std::setw(10) << after.queued[c][b];
+      out << "\n";
+    }
+  out << "\n";
+
+  out << "Aborted tasks dropped from queues: " << after.dropped << "\n";
+
+  out << "Time to first pixels: ";
+  if (after.first_pixels_count)
+    out << after.first_pixels_total/after.first_pixels_count << "ms mean over " << after.first_pixels_count << " images";
+  else
+    out << "no images yet";
+  if (r.first_pixels>=0.0)
+    out << " (" << r.first_pixels << "ms over the last " << after.first_pixels_count-before.first_pixels_count << ")";
+  out << "\n";
+
+  out
+    << "Farm lock: taken " << after.lock_taken << " times, "
+    << (after.lock_taken ? 100.0*after.lock_contended/after.lock_taken : 0.0) << "% contended, "
+    << 1000.0*after.lock_wait << "ms waiting ("
+    << 1000.0*(after.lock_wait-before.lock_wait) << "ms over the last " << r.interval << "s)\n";
+
+  out << "\nMemory (MB):";
+  unsigned long long memory=0;
+  for (uint c=0;c<MemoryAccount::Categories;c++)
+    {
+      out << " " << MemoryAccount::name(static_cast<MemoryAccount::Category>(c)) << " " << after.memory[c]/1048576.0 << ";";
+      memory+=after.memory[c];
+    }
+  out << " total " << memory/1048576.0 << " (peak " << after.memory_peak/1048576.0;
+  if (MemoryAccount::cap()) out << ", cap " << MemoryAccount::cap()/1048576.0;
+  out << ")\n";
+
+  return out;
+}
+
+std::ostream& MutatableImageComputerFarm::report_json(std::ostream& out,const Stats& before,const Stats& after)
+{
+  const Rates r(before,after);
+
+  out << std::fixed << std::setprecision(3);
+  out
+    << "{\"time\":" << after.time
+    << ",\"interval\":" << r.interval
+    << ",\"threads\":[";
+  for (uint i=0;i<after.threads.size();i++)
+    out
+      << (i ? "," : "")
+      << "{\"busy\":" << r.busy[i]
+      << ",\"samples_per_second\":" << r.samples[i]
+      << ",\"samples\":" << after.threads[i].samples
+      << ",\"completed\":" << after.threads[i].completed
+      << ",\"aborted\":" << after.threads[i].aborted
+      << ",\"deferred\":" << after.threads[i].deferred
+      << ",\"overruns\":" << after.threads[i].overruns
+      << "}";
+  out
+    << "],\"busy\":" << r.total_busy
+    << ",\"samples_per_second\":" << r.total_samples
+    << ",\"completed\":" << r.total.completed
+    << ",\"aborted\":" << r.total.aborted
+    << ",\"deferred\":" << r.total.deferred
+    << ",\"overruns\":" << r.total.overruns
+    << ",\"dropped\":" << after.dropped
+    << ",\"queued\":{";
+  for (uint c=0;c<2;c++)
+    {
+      out << (c ? ",\"enlargement\":[" : "\"grid\":[");
+      for (uint b=0;b<PriorityBands;b++)
+	out << (b ? "," : "") << after.queued[c][b];
+      out << "]";
+    }
+  out
+    << "},\"first_pixels_count\":" << after.first_pixels_count
+    << ",\"first_pixels_mean_ms\":" << (after.first_pixels_count ? static_cast<double>(after.first_pixels_total)/after.first_pixels_count : 0.0)
+    << ",\"lock_taken\":" << after.lock_taken
+    << ",\"lock_contended\":" << after.lock_contended
+    << ",\"lock_wait_ms\":" << 1000.0*after.lock_wait
+    << ",\"memory\":{";
+  for (uint c=0;c<MemoryAccount::Categories;c++)
+    {
+      // Category names as JSON keys: lower case, underscores for spaces.
+      std::string key(MemoryAccount::name(static_cast<MemoryAccount::Category>(c)));
+      for (uint i=0;i<key.size();i++)
+	key[i]=(key[i]==' ' ? '_' : tolower(key[i]));
+      out << (c ? "," : "") << "\"" << key << "\":" << after.memory[c];
+    }
+  out
+    << "},\"memory_peak\":" << after.memory_peak
+    << "}";
+  return out;
+}
@@ -34,6 +34,8 @@ class MutatableImageDisplay;
 
 //! Class encapsulating some compute threads and queues of tasks to be done and tasks completed.
 /*! Priority queues are implemented using multiset becase we want to be able to iterate over all members.
+  Grid and enlargement tasks are queued separately and share the threads according to tunable weights
+  (weighted fair queueing by samples computed): a class with nothing to do leaves its share to the other.
  */
 class MutatableImageComputerFarm
 {
@@ -62,8 +64,39 @@ class MutatableImageComputerFarm
     };
 
   //! Mutex for locking.  This is the ONLY thing the compute threads should ever block on.
+  /*! Take it with lock() (or a Lock) so time spent waiting for it is accounted for.
+   */
   mutable QMutex _mutex;
 
+  //! Seconds spent waiting to take _mutex (not counting waits for work to arrive).
+  mutable double _lock_wait;
+
+  //! Number of times _mutex has been taken.
+  mutable unsigned long long _lock_taken;
+
+  //! Number of times _mutex was already held when wanted.
+  mutable unsigned long long _lock_contended;
+
+  //! Take _mutex, accounting for any wait.
+  void lock() const;
+
+  //! Scoped lock on _mutex, taken with lock().
+  class Lock
+    {
+    public:
+      Lock(const MutatableImageComputerFarm& farm)
+	:_farm(farm)
+	{
+	  _farm.lock();
+	}
+      ~Lock()
+	{
+	  _farm._mutex.unlock();
+	}
+    private:
+      const MutatableImageComputerFarm& _farm;
+    };
+
   //! Wait condition for threads waiting for a new task.
   QWaitCondition _wait_condition;
 
@@ -73,8 +106,17 @@ class MutatableImageComputerFarm
   //! Convenience typedef.
   typedef std::multiset<boost::shared_ptr<MutatableImageComputerTask>,CompareTaskPriorityLoResFirst> TodoQueue;
 
-  //! Queue of tasks to be performed, lowest resolution first
-  TodoQueue _todo;
+  //! Queues of tasks to be performed, lowest resolution first: [0] for the grid, [1] for enlargements.
+  TodoQueue _todo[2];
+
+  //! Relative shares of the compute threads for grid [0] and enlargement [1] tasks.
+  uint _share[2];
+
+  //! Samples handed out to each class of task so far, divided by its share (i.e the class's "virtual time").
+  /*! The class furthest behind gets the next task.
+    A class with nothing queued is brought forward as the other runs, so it can't bank time while idle.
+   */
+  double _charged[2];
 
   //! Conveniencetypedef.
   typedef std::multiset<boost::shared_ptr<MutatableImageComputerTask>,CompareTaskPriorityHiResFirst> DoneQueue;
@@ -84,8 +126,27 @@ class MutatableImageComputerFarm
    */
   typedef std::map<const MutatableImageDisplay*,DoneQueue> DoneQueueByDisplay;
 
+  //! Node of the lock-free stack which compute threads push completed tasks on to.
+  struct DoneNode
+  {
+    boost::shared_ptr<MutatableImageComputerTask> task;
+    DoneNode* next;
+  };
+
+  //! Completed tasks pushed by the compute threads, most recent first.
+  /*! Taken all at once by the GUI thread (see take_done_incoming) without any locking.
+   */
+  QAtomicPointer<DoneNode> _done_incoming;
+
+  //! Number of grid [0] and enlargement [1] tasks on the _done_incoming stack (approximate; only used for the task count).
+  QAtomicInt _done_incoming_count[2];
+
+  //! Object to be sent a queued tasks_done() invocation when completed tasks arrive (may be null).
+  QObject*const _done_receiver;
+
   //! Queue of tasks completed awaiting display.
-  /*! We reverse the compute priority so that highest resolution images get displayed first.
+  /*! Only ever accessed from the GUI thread, so needs no locking.
+      We reverse the compute priority so that highest resolution images get displayed first.
       Lower resolution ones arriving later should be discarded by the displays.
       This mainly makes a difference for animation where enlarging multiple low resolution 
       images to screen res takes a lot of time.  May help low-bandwidth X11 connections
@@ -97,10 +158,30 @@ class MutatableImageComputerFarm
   //! Points to the next display queue to be returned (could be .end())
   DoneQueueByDisplay::iterator _done_position;
 
+  //! Aborted tasks thrown away from the todo queue (protected by _mutex)...
+  unsigned long long _dropped_todo;
+
+  //! ...and from the done queues (GUI thread only).
+  unsigned long long _dropped_done;
+
+  //! Number of images which have had their first pixels delivered (GUI thread only).
+  uint _first_pixels_count;
+
+  //! Total time (ms) from load to first pixels over those images (GUI thread only).
+  unsigned long long _first_pixels_total;
+
+  //! Compute time (ns) allowed per sample of a task before it's downgraded (0 for no limit).
+  /*! Read by the compute threads at the start of each task, so needs no lock.
+   */
+  QAtomicInt _task_budget_ns;
+
  public:
 
   //! Constructor.
-  MutatableImageComputerFarm(uint n_threads,int niceness);
+  /*! done_receiver must have a tasks_done() slot; it is invoked (queued, so in the receiver's thread)
+      whenever completed tasks become available after the done queue was drained.
+   */
+  MutatableImageComputerFarm(uint n_threads,int niceness,QObject* done_receiver=0);
 
   //! Destructor cleans up threads.
   ~MutatableImageComputerFarm();
@@ -111,29 +192,129 @@ class MutatableImageComputerFarm
       return _computers.size();
     }
 
-  //! Move aborted tasks from todo queue to done queue.
-  void fasttrack_aborted();
+  //! Set the relative shares of the compute threads for grid and enlargement tasks (takes effect immediately).
+  void shares(uint grid,uint enlargement);
+
+  //! Set the compute time (seconds) allowed per sample of a task (0 for no limit; takes effect from the next task started).
+  /*! A task running over it is downgraded (see MutatableImageComputer::downgrade) to free its thread sooner.
+   */
+  void task_budget(double seconds);
+
+  //! Accessor.
+  double task_budget() const;
 
-  //! Enqueue a task for computing.
+  //! Enqueue a task for computing, deferring the least important running tasks if no worker would otherwise be free for it.
   void push_todo(const boost::shared_ptr<MutatableImageComputerTask>&);
 
-  //! Remove a task from the head of the todo queue (returns null if none).
-  const boost::shared_ptr<MutatableImageComputerTask> pop_todo(MutatableImageComputer& requester);
+  //! Enqueue several tasks for computing, taking the lock only once.
+  void push_todo(const std::vector<boost::shared_ptr<MutatableImageComputerTask> >&);
+
+  //! Return deferred (possibly partially completed) tasks to the todo queue.  Never defers anything else: they're the ones making way.
+  void push_deferred(const std::deque<boost::shared_ptr<MutatableImageComputerTask> >&);
+
+  //! Remove the task at the head of the todo queue into batch, blocking until there is one (leaves batch empty if killed).
+  /*! If it's small, more small tasks are taken with it to be computed as a unit.
+    Aborted tasks are discarded on the way.
+   */
+  void pop_todo(MutatableImageComputer& requester,std::deque<boost::shared_ptr<MutatableImageComputerTask> >& batch);
 
-  //! Enqueue a task for display.
-  void push_done(const boost::shared_ptr<MutatableImageComputerTask>&);
+  //! Enqueue tasks for display, together.  Lock-free; called from the compute threads.
+  void push_done(const std::vector<boost::shared_ptr<MutatableImageComputerTask> >&);
 
-  //! Remove a task from the head of the display queue (returns null if none).
+  //! Remove a task from the head of the display queue (returns null if none).  GUI thread only.
+  /*! Aborted tasks are discarded on the way.
+   */
   const boost::shared_ptr<MutatableImageComputerTask> pop_done();
 
+ protected:
+
+  //! Remove a task from the head of the display queue, aborted or not (returns null if none).
+  const boost::shared_ptr<MutatableImageComputerTask> pop_done_any();
+
+  //! Move everything pushed by the compute threads into the per-display done queues.  GUI thread only.
+  void take_done_incoming();
+
+  //! Defer running tasks if the workers are needed for the given one (to be queued).  Called with the mutex held.
+  void preempt_for(const MutatableImageComputerTask&);
+
+  //! Which class of task (0 for grid, 1 for enlargement) should be computed next; -1 if there are none.  Called with the mutex held.
+  int next_class() const;
+
+  //! Account for a task of the given class having been taken.  Called with the mutex held.
+  void charge(uint c,uint samples);
+
+ public:
+
   //! Flags all tasks in all queues as aborted, and signals the compute threads to abort their current task.
+  /*! Aborting a single display's tasks needs nothing from the farm: see MutatableImageDisplay::abort_tasks.
+   */
   void abort_all();
 
-  //! Flags all tasks for a particular display as aborted (including compute threads)
-  void abort_for(const MutatableImageDisplay* disp);
+  //! Number of grid or enlargement tasks in queues
+  uint tasks(bool enlargement) const;
+
+  //! Number of bands queued tasks are counted in by priority (i.e by samples, weighted by cost): see priority_band.
+  enum {PriorityBands=3};
+
+  //! The band a priority falls in: up to 64x64 typical samples, up to 256x256, or more.
+  static uint priority_band(uint priority);
+
+  //! A snapshot of the farm's counters.  Rates come from the difference between two.
+  struct Stats
+  {
+    Stats();
+
+    //! When taken (FunctionProfile::now()).
+    double time;
 
-  //! Number of tasks in queues
-  uint tasks() const;
+    //! Each compute thread's totals.
+    std::vector<MutatableImageComputer::Stats> threads;
+
+    //! Tasks waiting to be computed, for the grid [0] and enlargements [1], by priority band.
+    uint queued[2][PriorityBands];
+
+    //! Aborted tasks thrown away from the queues.
+    unsigned long long dropped;
+
+    //! Number of images which have had their first pixels delivered.
+    uint first_pixels_count;
+
+    //! Total time (ms) from load to first pixels over those images.
+    unsigned long long first_pixels_total;
+
+    //! Seconds spent waiting for the farm's lock.
+    double lock_wait;
+
+    //! Number of times the farm's lock has been taken.
+    unsigned long long lock_taken;
+
+    //! Number of times the farm's lock was already held when wanted.
+    unsigned long long lock_contended;
+
+    //! Bytes of memory held, by category (see MemoryAccount).
+    unsigned long long memory[MemoryAccount::Categories];
+
+    //! Peak bytes of memory held in total.
+    unsigned long long memory_peak;
+  };
+
+  //! Take a snapshot of the counters.  GUI thread only.
+  const Stats stats() const;
+
+  //! Write a readable summary: totals as of after, rates over the time since before.
+  static std::ostream& report(std::ostream& out,const Stats& before,const Stats& after);
+
+  //! As report, but as a single line JSON object.
+  static std::ostream& report_json(std::ostream& out,const Stats& before,const Stats& after);
+
+  //! Note the time (ms) from an image being loaded to its first pixels being delivered.  GUI thread only.
+  void first_pixels_delivered(int ms);
+
+  //! Mean time (ms) from load to first pixels so far.
+  uint first_pixels_mean() const
+    {
+      return (_first_pixels_count ? _first_pixels_total/_first_pixels_count : 0);
+    }
 };
 
 #endif
@@ -25,45 +25,58 @@
 
 #include "mutatable_image_computer_task.h"
 
+#include "mutatable_image_computer_buffer.h"
+
 MutatableImageComputerTask::MutatableImageComputerTask
 (
  MutatableImageDisplay*const disp,
  const boost::shared_ptr<const MutatableImage>& fn,
+ const boost::shared_ptr<MutatableImageComputerBuffer>& buf,
  uint pri,
  const QSize& fo,
  const QSize& fs,
- const QSize& wis,
- uint f,
  uint lev,
  uint frag,
  uint nfrag,
  bool j,
  uint ms,
- unsigned long long int n
+ unsigned long long int n,
+ const boost::shared_ptr<const QAtomicInt>& gen,
+ bool p,
+ bool e,
+ MutatableImage::Heatmap h
  )
   :
 #ifndef NDEBUG
   InstanceCounted(typeid(this).name(),false),
 #endif
   _aborted(false)
+  ,_generation_counter(gen)
+  ,_generation(*gen)
   ,_display(disp)
   ,_image_function(fn)
+  ,_buffer(buf)
   ,_priority(pri)
   ,_fragment_origin(fo)
   ,_fragment_size(fs)
-  ,_whole_image_size(wis)
-  ,_frames(f)
   ,_level(lev)
   ,_fragment(frag)
   ,_number_of_fragments(nfrag)
   ,_jittered_samples(j)
   ,_multisample_grid(ms)
+  ,_computed_image_function(fn)
+  ,_computed_multisample_grid(ms)
+  ,_downgrade(1)
   ,_current_pixel(0)
   ,_current_col(0)
   ,_current_row(0)
   ,_current_frame(0)
   ,_completed(false)
   ,_serial(n)
+  ,_probe(p)
+  ,_enlargement(e)
+  ,_heatmap(h)
+  ,_memory(MemoryAccount::Tasks,sizeof(MutatableImageComputerTask))
 {
   /*
   std::cerr 
@@ -72,26 +85,45 @@ MutatableImageComputerTask::MutatableImageComputerTask
     << ":" 
     << _fragment_size.width() << "x" << _fragment_size.height() 
     << " in " 
-    << _whole_image_size.width() << "x" << _whole_image_size.height()
+    << whole_image_size().width() << "x" << whole_image_size().height()
     << "]";
   */
   assert(_image_function->ok());
   assert(_fragment<_number_of_fragments);
-  assert(_number_of_fragments>1 || _whole_image_size==_fragment_size);
+  assert(_fragment_origin.width()+_fragment_size.width()<=whole_image_size().width());
+  assert(_fragment_origin.height()+_fragment_size.height()<=whole_image_size().height());
   assert(1<=_multisample_grid);
 }
 
-void MutatableImageComputerTask::allocate_images() const
+MutatableImageComputerTask::~MutatableImageComputerTask()
 {
-  for (uint f=0;f<frames();f++)
-    {
-      _images.push_back(QImage(fragment_size(),QImage::Format_RGB32));
-    }
+  assert(_image_function->ok());
 }
 
-MutatableImageComputerTask::~MutatableImageComputerTask()
+const QSize& MutatableImageComputerTask::whole_image_size() const
 {
-  assert(_image_function->ok());
+  return _buffer->size();
+}
+
+uint MutatableImageComputerTask::frames() const
+{
+  return _buffer->frames();
+}
+
+bool MutatableImageComputerTask::redundant() const
+{
+  return _buffer->fragment_done(_fragment);
+}
+
+/*! Blocks stop at 16 pixels square: coarser than that and the image is no use as a preview of itself.
+ */
+bool MutatableImageComputerTask::downgrade(const boost::shared_ptr<const MutatableImage>& fn)
+{
+  const bool cut=(fn || _computed_multisample_grid>1 || _downgrade<16);
+  if (fn) _computed_image_function=fn;
+  _computed_multisample_grid=1;
+  _downgrade=std::min(2*_downgrade,16u);
+  return cut;
 }
 
 void MutatableImageComputerTask::pixel_advance()
@@ -109,6 +141,7 @@ void MutatableImageComputerTask::pixel_advance()
 	  if (_current_frame==frames())
 	    {
 	      _completed=true;
+	      _buffer->fragment_completed(_fragment);
 	    }
 	}
     }
@@ -27,6 +27,8 @@
 #include "mutatable_image.h"
 #include "mutatable_image_display.h"
 
+class MutatableImageComputerBuffer;
+
 //! Class encapsulating all the parameters of, and output from, a single image generation run.
 class MutatableImageComputerTask
 #ifndef NDEBUG
@@ -40,6 +42,16 @@ class MutatableImageComputerTask
    */
   bool _aborted;
 
+  //! The originating display's generation counter.
+  /*! The display increments it to abort all its outstanding tasks at once;
+    tasks constructed for an earlier generation are stale and are dropped wherever they're next looked at.
+    Shared so it outlives the display for any tasks still in flight.
+   */
+  const boost::shared_ptr<const QAtomicInt> _generation_counter;
+
+  //! Value of the generation counter when this task was created.
+  const int _generation;
+
   //! The display originating the task, and to which the output will be returned.
   MutatableImageDisplay*const _display;
 
@@ -48,6 +60,9 @@ class MutatableImageComputerTask
    */
   const boost::shared_ptr<const MutatableImage> _image_function;
 
+  //! Where the pixels go.  Shared with the other fragments of the same rendering.
+  const boost::shared_ptr<MutatableImageComputerBuffer> _buffer;
+
   //! Task priority.
   /*! Low numbers go to the head of the queue.
     The total number of samples in the complete (non-fragmented) image is used,
@@ -61,12 +76,6 @@ class MutatableImageComputerTask
   //! The size of the image to be generated.
   const QSize _fragment_size;
 
-  //! The full size of the image of which this is a fragment.
-  const QSize _whole_image_size;
-
-  //! Number of animation frames to be rendered
-  const uint _frames;
-
   //! The resolution level of this image (0=1-for-1 pixels, 1=half res etc)
   /*! This is tracked because multiple compute threads could return the completed tasks out of order
     (Unlikely given the huge difference in the amount of compute between levels, but possible).
@@ -85,6 +94,15 @@ class MutatableImageComputerTask
   //! Multisampling grid resolution e.g 4 implies a 4x4 grid
   const uint _multisample_grid;
 
+  //@{
+  //! What's actually computed, which differs from the above once the task has been downgraded for overrunning its time budget.
+  /*! Only touched by the compute thread running the task.
+   */
+  boost::shared_ptr<const MutatableImage> _computed_image_function;
+  uint _computed_multisample_grid;
+  uint _downgrade;
+  //@}
+
   //@{
   //! Track pixels computed, so tasks can be restarted after defer.  Row and column are relative to the fragment origin.
   uint _current_pixel;
@@ -93,48 +111,53 @@ class MutatableImageComputerTask
   uint _current_frame;
   //@}
 
-  //! The image data generated for the fragments.
-  /*! This is lazily created to avoid multiple high resolution
-    images (especially with multisampling) being unnecessarily
-    concurrently allocated.
-   */
-  mutable std::vector<QImage> _images;
-
-  //! Lazy allocator for _images (which is mutable)
-  void allocate_images() const;
-  
   //! Set true by pixel_advance when it advances off the last frame.
   bool _completed;
 
   //! Serial number, to fix some occasional out-of-order display problems
   unsigned long long int _serial;
 
+  //! Whether this is a probe render, used to decide whether an image is worth rendering properly.
+  const bool _probe;
+
+  //! Whether this is for an enlargement rather than the grid (they get separate shares of the compute farm).
+  const bool _enlargement;
+
+  //! What to compute a heatmap of instead of the image's colours (if anything).
+  const MutatableImage::Heatmap _heatmap;
+
+  //! Accounts for the task itself (its pixels are the buffer's).
+  const MemoryAccount::Charge _memory;
+
  public:
   //! Constructor.
   MutatableImageComputerTask
     (
      MutatableImageDisplay*const disp,
      const boost::shared_ptr<const MutatableImage>& fn,
+     const boost::shared_ptr<MutatableImageComputerBuffer>& buf,
      uint pri,
      const QSize& fo,
      const QSize& fs,
-     const QSize& wis,
-     uint f,
      uint lev,
      uint frag,
      uint nfrag,
      bool j,
      uint ms,
-     unsigned long long int n
+     unsigned long long int n,
+     const boost::shared_ptr<const QAtomicInt>& gen,
+     bool p,
+     bool e,
+     MutatableImage::Heatmap h
      );
   
   //! Destructor.
   ~MutatableImageComputerTask();
 
-  //! Accessor.
+  //! Whether the task has been aborted, either explicitly or by its display moving on to a new generation.
   bool aborted() const
     {
-      return _aborted;
+      return _aborted || static_cast<int>(*_generation_counter)!=_generation;
     }
 
   //! Mark task as aborted.
@@ -155,6 +178,12 @@ class MutatableImageComputerTask
       return _image_function;
     }
 
+  //! Accessor.
+  const boost::shared_ptr<MutatableImageComputerBuffer>& buffer() const
+    {
+      return _buffer;
+    }
+
   //! Accessor.
   const QSize& fragment_origin() const
     {
@@ -167,17 +196,11 @@ class MutatableImageComputerTask
       return _fragment_size;
     }
 
-  //! Accessor.
-  const QSize& whole_image_size() const
-    {
-      return _whole_image_size;
-    }
+  //! The full size of the image of which this is a fragment.
+  const QSize& whole_image_size() const;
 
-  //! Accessor.
-  uint frames() const
-    {
-      return _frames;
-    }
+  //! Number of animation frames to be rendered.
+  uint frames() const;
 
   //! Accessor.
   uint level() const
@@ -209,6 +232,36 @@ class MutatableImageComputerTask
       return _multisample_grid;
     }
 
+  //! The image function pixels are actually computed with (iterations may have been capped by a downgrade).
+  const boost::shared_ptr<const MutatableImage>& computed_image_function() const
+    {
+      return _computed_image_function;
+    }
+
+  //! The multisampling grid actually used (1 once downgraded).
+  uint computed_multisample_grid() const
+    {
+      return _computed_multisample_grid;
+    }
+
+  //! Size of the blocks of pixels computed once and copied (1 unless downgraded).
+  uint downgrade() const
+    {
+      return _downgrade;
+    }
+
+  //! Whether the task has been downgraded.
+  bool downgraded() const
+    {
+      return _downgrade>1 || _computed_multisample_grid!=_multisample_grid || _computed_image_function!=_image_function;
+    }
+
+  //! Make the rest of the task cheaper: drop multisampling and double the block size (up to a limit).
+  /*! A non-null fn replaces the function computed (e.g one with capped iterations).
+    Returns false if there was nothing left to cut.
+   */
+  bool downgrade(const boost::shared_ptr<const MutatableImage>& fn);
+
   //! Serial number
   unsigned long long int serial() const
     {
@@ -216,23 +269,33 @@ class MutatableImageComputerTask
     }
 
   //! Accessor.
-  uint priority() const
+  bool probe() const
     {
-      return _priority;
+      return _probe;
+    }
+
+  //! Accessor.
+  bool enlargement() const
+    {
+      return _enlargement;
     }
 
-  //! Accessor, with lazy creation.
-  std::vector<QImage>& images()
+  //! Accessor.
+  MutatableImage::Heatmap heatmap() const
     {
-      if (_images.empty()) allocate_images();
-      return _images;
+      return _heatmap;
     }
 
   //! Accessor.
-  const std::vector<QImage>& images() const
+  uint priority() const
     {
-      if (_images.empty()) allocate_images();
-      return _images;
+      return _priority;
+    }
+
+  //! Number of samples this task computes (i.e a measure of its cost).
+  uint samples() const
+    {
+      return _fragment_size.width()*_fragment_size.height()*frames()*_multisample_grid*_multisample_grid;
     }
 
   //! Accessor.
@@ -265,7 +328,10 @@ class MutatableImageComputerTask
       return _completed;
     }
 
-  //! Increment pixel count, set completed flag if advanced off end of last frame.
+  //! Whether the task's fragment has already been done by another task (a tile requeued after scrolling).
+  bool redundant() const;
+
+  //! Increment pixel count, set completed flag (and tell the buffer) if advanced off end of last frame.
   void pixel_advance();
 };
 
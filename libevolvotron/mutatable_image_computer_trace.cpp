@@ -0,0 +1,258 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class MutatableImageComputerTrace.
+*/
+
+#include "libevolvotron_precompiled.h"
+
+#include "mutatable_image_computer_trace.h"
+
+#include "mutatable_image_computer_task.h"
+
+bool MutatableImageComputerTrace::_enabled=false;
+
+namespace
+{
+  //! Everything worth knowing about a task at the time of an event.
+  struct Record
+  {
+    double time;
+    MutatableImageComputerTrace::Event event;
+    const void* task;
+    const void* display;
+    unsigned long long serial;
+    uint level;
+    uint fragment;
+    uint fragments;
+    uint priority;
+    uint samples;
+    bool enlargement;
+  };
+
+  //! One thread's events.  Only ever appended to by its own thread.
+  struct ThreadData
+  {
+    ThreadData()
+      :dropped(0)
+      {}
+
+    std::string name;
+    std::deque<Record> records;
+
+    //! Events not recorded because the buffer was full.
+    unsigned long long dropped;
+  };
+
+  //! Per-thread cap on events (about 20MB each); a busy session makes a few hundred thousand between all its threads.
+  const size_t max_records=1<<18;
+
+  //! Where to write.
+  std::string filename;
+
+  //! Time recording started; events are timed relative to it.
+  double origin=0.0;
+
+  //! Guards the list of all threads' data.
+  QMutex threads_mutex;
+
+  //! Every thread's data, in order of first event.  Never freed: events outlive the threads which recorded them.
+  std::vector<ThreadData*> threads;
+
+  //! This thread's data (null until it first records anything).
+  __thread ThreadData* this_thread=0;
+
+  ThreadData& thread_data()
+  {
+    if (!this_thread)
+      {
+	this_thread=new ThreadData;
+	QMutexLocker lock(&threads_mutex);
+	threads.push_back(this_thread);
+      }
+    return *this_thread;
+  }
+
+  const char* event_name(MutatableImageComputerTrace::Event e)
+  {
+    switch (e)
+      {
+      case MutatableImageComputerTrace::Enqueue: return "enqueue";
+      case MutatableImageComputerTrace::Pop: return "pop";
+      case MutatableImageComputerTrace::Start: return "start";
+      case MutatableImageComputerTrace::Defer: return "defer";
+      case MutatableImageComputerTrace::Abort: return "abort";
+      case MutatableImageComputerTrace::Complete: return "complete";
+      case MutatableImageComputerTrace::Downgrade: return "downgrade";
+      case MutatableImageComputerTrace::Deliver: return "deliver";
+      }
+    return "unknown";
+  }
+
+  //! Microseconds since recording started.
+  long long microseconds(double t)
+  {
+    return llrint(1e6*(t-origin));
+  }
+
+  //! Common fields (up to, but not including, args) of an event.
+  std::ostream& write_head(std::ostream& out,const std::string& name,char phase,uint tid,const Record& r)
+  {
+    return out
+      << "{\"name\":\"" << name << "\",\"cat\":\"" << (r.enlargement ? "enlargement" : "grid") << "\""
+      << ",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << tid
+      << ",\"ts\":" << microseconds(r.time);
+  }
+
+  //! Task details.
+  std::ostream& write_args(std::ostream& out,const Record& r,const char* end)
+  {
+    out
+      << ",\"args\":{\"task\":\"" << r.task << "\",\"display\":\"" << r.display << "\""
+      << ",\"serial\":" << r.serial
+      << ",\"level\":" << r.level
+      << ",\"fragment\":\"" << r.fragment << "/" << r.fragments << "\""
+      << ",\"priority\":" << r.priority
+      << ",\"samples\":" << r.samples;
+    if (end) out << ",\"end\":\"" << end << "\"";
+    return out << "}}";
+  }
+}
+
+void MutatableImageComputerTrace::start(const std::string& f)
+{
+  filename=f;
+  origin=FunctionProfile::now();
+  _enabled=true;
+}
+
+void MutatableImageComputerTrace::name_thread(const std::string& name)
+{
+  if (_enabled) thread_data().name=name;
+}
+
+void MutatableImageComputerTrace::record_event(Event event,const MutatableImageComputerTask& task)
+{
+  ThreadData& t=thread_data();
+  if (t.records.size()>=max_records)
+    {
+      t.dropped++;
+      return;
+    }
+
+  Record r;
+  r.time=FunctionProfile::now();
+  r.event=event;
+  r.task=&task;
+  r.display=task.display();
+  r.serial=task.serial();
+  r.level=task.level();
+  r.fragment=task.fragment();
+  r.fragments=task.number_of_fragments();
+  r.priority=task.priority();
+  r.samples=task.samples();
+  r.enlargement=task.enlargement();
+  t.records.push_back(r);
+}
+
+/*! A thread computes one task at a time, so each start is paired with the next defer, abort or complete on the same thread
+  to make a span (downgrades in between are instants within it).  Anything unpaired (e.g an abort of a task dropped from the queue) is written as an instant.
+ */
+bool MutatableImageComputerTrace::write()
+{
+  if (!_enabled) return true;
+
+  std::ofstream out(filename.c_str());
+  if (!out)
+    {
+      std::cerr << "Couldn't open trace file " << filename << "\n";
+      return false;
+    }
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first=true;
+  unsigned long long dropped=0;
+
+  QMutexLocker lock(&threads_mutex);
+  for (uint i=0;i<threads.size();i++)
+    {
+      const ThreadData& t=*threads[i];
+      const uint tid=i+1;
+      dropped+=t.dropped;
+
+      if (!t.name.empty())
+	{
+	  out << (first ? "" : ",\n")
+	      << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+	      << ",\"args\":{\"name\":\"" << t.name << " " << tid << "\"}}";
+	  first=false;
+	}
+
+      const Record* started=0;
+      for (std::deque<Record>::const_iterator it=t.records.begin();it!=t.records.end();it++)
+	{
+	  const Record& r=*it;
+	  if (r.event==Start)
+	    {
+	      started=&r;
+	      continue;
+	    }
+
+	  out << (first ? "" : ",\n");
+	  first=false;
+
+	  // Happens part way through a span, so is an instant which doesn't end it.
+	  if (r.event==Downgrade)
+	    {
+	      write_head(out,event_name(r.event),'i',tid,r) << ",\"s\":\"t\"";
+	      write_args(out,r,0);
+	      continue;
+	    }
+
+	  const bool ends=(r.event==Defer || r.event==Abort || r.event==Complete);
+	  if (ends && started && started->task==r.task)
+	    {
+	      std::ostringstream name;
+	      name << "level " << r.level;
+	      write_head(out,name.str(),'X',tid,*started) << ",\"dur\":" << microseconds(r.time)-microseconds(started->time);
+	      write_args(out,r,event_name(r.event));
+	    }
+	  else
+	    {
+	      write_head(out,event_name(r.event),'i',tid,r) << ",\"s\":\"t\"";
+	      write_args(out,r,0);
+	    }
+	  started=0;
+	}
+    }
+  out << "\n]}\n";
+
+  if (dropped)
+    std::cerr << "Trace buffers were full: " << dropped << " events not recorded\n";
+
+  out.close();
+  if (!out)
+    {
+      std::cerr << "Couldn't write trace file " << filename << "\n";
+      return false;
+    }
+  std::clog << "Wrote trace to " << filename << "\n";
+  return true;
+}
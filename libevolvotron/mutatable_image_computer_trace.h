@@ -0,0 +1,83 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class MutatableImageComputerTrace.
+*/
+
+#ifndef _mutatable_image_computer_trace_h_
+#define _mutatable_image_computer_trace_h_
+
+class MutatableImageComputerTask;
+
+//! Optional recording of compute task lifecycle events, for viewing as a timeline.
+/*! Each thread appends to its own buffer, so recording takes no locks
+  (a mutex is only taken the first time a thread records anything).
+  The buffers are only read by write(), which must only be called once nothing else is recording
+  (i.e after the compute farm has shut down).
+  Output is Chrome trace-event JSON (for chrome://tracing or Perfetto):
+  each stint of computing a task shows as a span on its compute thread, from start to defer, abort or complete,
+  and the other events show as instants.
+ */
+class MutatableImageComputerTrace
+{
+ public:
+  //! Things which happen to tasks.
+  enum Event
+    {
+      Enqueue,   //!< Queued by a display (GUI thread).
+      Pop,       //!< Taken from the queue by a compute thread.
+      Start,     //!< Computing starts (or resumes, after a defer).
+      Defer,     //!< Computing stops to make way for more important tasks; the task is requeued.
+      Abort,     //!< Computing stops (or the task is dropped from a queue) because its display has moved on.
+      Complete,  //!< Computing finishes.
+      Downgrade, //!< Computing continues more coarsely because the task has overrun its budget.
+      Deliver    //!< Handed to its display (GUI thread).
+    };
+
+  //! Start recording, to be written to the given file.
+  static void start(const std::string& filename);
+
+  //! Whether recording.
+  static bool enabled()
+    {
+      return _enabled;
+    }
+
+  //! Name the calling thread in the timeline.
+  static void name_thread(const std::string& name);
+
+  //! Record an event for a task (if recording).
+  static void record(Event event,const MutatableImageComputerTask& task)
+    {
+      if (_enabled) record_event(event,task);
+    }
+
+  //! Write everything recorded to the file given to start.  Returns false (with the reason on stderr) if it can't.
+  static bool write();
+
+ private:
+  //! Whether recording.
+  static bool _enabled;
+
+  //! Out of line part of record.
+  static void record_event(Event event,const MutatableImageComputerTask& task);
+};
+
+#endif
@@ -27,6 +27,7 @@
 
 #include "mutatable_image_display_big.h"
 #include "evolvotron_main.h"
+#include "mutatable_image_computer_buffer.h"
 #include "mutatable_image_computer_task.h"
 #include "transform_factory.h"
 #include "function_pre_transform.h"
@@ -50,15 +51,31 @@ MutatableImageDisplay::MutatableImageDisplay(EvolvotronMain* mn,bool full_functi
   ,_current_frame(0)
   ,_animate_reverse(false)
   ,_timer(0)
-  ,_resize_in_progress(false)
+  ,_resize_timer(0)
   ,_current_display_level(0)
   ,_current_display_multisample_grid(0)
+  ,_tiled_priority(0)
+  ,_tile_timer(0)
   ,_icon_serial(0LL)
+  ,_memory(MemoryAccount::DisplayImages)
+  ,_released(false)
+  ,_downgraded(false)
   ,_properties(0)
   ,_menu(0)
   ,_menu_big(0)
   ,_menu_item_action_lock(0)
+  ,_menu_heatmap(0)
+  ,_heatmap(MutatableImage::HeatmapNone)
+  ,_adjust_kind(AdjustNone)
+  ,_adjust_transform(TransformIdentity())
+  ,_adjust_pan(0,0)
+  ,_adjust_zoom(1.0)
+  ,_adjust_in_flight(false)
   ,_serial(0LL)
+  ,_generation(new QAtomicInt(0))
+  ,_probing(false)
+  ,_probe_attempts(0)
+  ,_probe_one_of_many(false)
 {
   setAttribute(Qt::WA_DeleteOnClose,true);
 
@@ -123,6 +140,15 @@ MutatableImageDisplay::MutatableImageDisplay(EvolvotronMain* mn,bool full_functi
 
   _menu->addSeparator();
   _menu->addAction("Simplify function",this,SLOT(menupick_simplify()));
+
+  _menu_heatmap=_menu->addMenu("Heatmap");
+  _menu_item_action_heatmap[MutatableImage::HeatmapNone]=_menu_heatmap->addAction("Off",this,SLOT(menupick_heatmap_off()));
+  _menu_item_action_heatmap[MutatableImage::HeatmapEvaluations]=_menu_heatmap->addAction("Function evaluations",this,SLOT(menupick_heatmap_evaluations()));
+  _menu_item_action_heatmap[MutatableImage::HeatmapTime]=_menu_heatmap->addAction("Time",this,SLOT(menupick_heatmap_time()));
+  for (uint i=0;i<3;i++)
+    _menu_item_action_heatmap[i]->setCheckable(true);
+  _menu_item_action_heatmap[MutatableImage::HeatmapNone]->setChecked(true);
+
   _menu->addAction("Properties...",this,SLOT(menupick_properties()));
 
   main().hello(this);
@@ -134,7 +160,7 @@ MutatableImageDisplay::MutatableImageDisplay(EvolvotronMain* mn,bool full_functi
 
   for (uint f=0;f<_frames;f++)
     {
-      _offscreen_pixmaps.push_back(QPixmap());
+      _offscreen_display_images.push_back(QImage());
     }
 
   _timer=new QTimer(this);
@@ -144,6 +170,22 @@ MutatableImageDisplay::MutatableImageDisplay(EvolvotronMain* mn,bool full_functi
      this,SLOT(frame_advance())
      );
   if (_frames>1) _timer->start(1000/_framerate);
+
+  _tile_timer=new QTimer(this);
+  _tile_timer->setSingleShot(true);
+  connect
+    (
+     _tile_timer,SIGNAL(timeout()),
+     this,SLOT(retile())
+     );
+
+  _resize_timer=new QTimer(this);
+  _resize_timer->setSingleShot(true);
+  connect
+    (
+     _resize_timer,SIGNAL(timeout()),
+     this,SLOT(resized())
+     );
 }
 
 /*! Destructor signs off from EvolvotronMain to prevent further attempts at completed task delivery.
@@ -156,12 +198,12 @@ MutatableImageDisplay::~MutatableImageDisplay()
   // Don't use main() because it asserts non-null.
   if (_main)
     {
-      farm().abort_for(this);
+      abort_tasks();
       main().goodbye(this);
     }
 
   _image_function.reset();
-  _offscreen_pixmaps.clear();
+  _offscreen_display_images.clear();
 
   _offscreen_images.clear();
 }
@@ -228,6 +270,24 @@ void MutatableImageDisplay::frame_advance()
 }
 
 void MutatableImageDisplay::image_function(const boost::shared_ptr<const MutatableImage>& i,bool one_of_many)
+{
+  _probing=false;
+  _probe_parent.reset();
+
+  load(i,one_of_many);
+}
+
+void MutatableImageDisplay::image_function_probed(const boost::shared_ptr<const MutatableImage>& i,const boost::shared_ptr<const MutatableImage>& parent,bool one_of_many)
+{
+  _probing=(main().mutation_parameters().probe_threshold()>0.0);
+  _probe_parent=parent;
+  _probe_attempts=0;
+  _probe_one_of_many=one_of_many;
+
+  load(i,one_of_many);
+}
+
+void MutatableImageDisplay::load(const boost::shared_ptr<const MutatableImage>& i,bool one_of_many,bool render)
 {
   assert(_image_function.get()==0 || _image_function->ok());
   assert(i.get()==0 || i->ok());
@@ -236,7 +296,7 @@ void MutatableImageDisplay::image_function(const boost::shared_ptr<const Mutatab
   _serial++;
 
   // This might have already been done (e.g by resizeEvent), but it can't hurt to be sure.
-  farm().abort_for(this);
+  abort_tasks();
 
   // Careful: we could be passed our own existing (and already owned) image
   // (a trick used by resize to trigger recompute & redisplay)
@@ -249,8 +309,9 @@ void MutatableImageDisplay::image_function(const boost::shared_ptr<const Mutatab
       if (one_of_many)
 	{
 	  // Clear any existing image data - stops old animations continuing to play 
-	  for (uint f=0;f<_offscreen_pixmaps.size();f++)
-	    _offscreen_pixmaps[f].fill(QColor(0,0,0));
+	  for (uint f=0;f<_offscreen_display_images.size();f++)
+	    _offscreen_display_images[f]=QImage();
+	  charge_memory();
 	  
 	  // Queue a redraw
 	  update();
@@ -260,91 +321,411 @@ void MutatableImageDisplay::image_function(const boost::shared_ptr<const Mutatab
   // If we start recomputing again we need to accept any delivered images.
   _current_display_level=static_cast<uint>(-1);
   _current_display_multisample_grid=static_cast<uint>(-1);
+  _load_time.start();
+  _released=false;
+  _downgraded=false;
+
+  // Any tiles still to come are for the old image
+  _tiled_buffer.reset();
 
-  // Clear up staging area... its contents are now useless
-  _offscreen_images_inbox.clear();
+  // Mid-button adjustments still waiting were relative to the old image
+  _adjust_kind=AdjustNone;
+  _adjust_transform=TransformIdentity();
+  _adjust_pan=QPoint(0,0);
+  _adjust_zoom=1.0;
+  _adjust_in_flight=false;
 
   // Update lock status displayed in menu
   if (_menu_item_action_lock)
     _menu_item_action_lock->setChecked(_image_function.get() ? _image_function->locked() : false);
   
-  if (_image_function.get())
+  if (_image_function.get() && render)
     {
-      // Allow for displays up to 4096 pixels high or wide
-      for (int level=12;level>=0;level--)
+      if (_probing)
 	{
-	  const int s=(1<<level);
-	  const QSize render_size(image_size()/s);
-	  
-	  // Don't bother rendering anything less than 4x4 unless that's all there is
-	  if ((render_size.width()>=4 && render_size.height()>=4) || level==0)
+	  // Probe is a single small fragment at top priority
+	  const QSize probe_size(16,16);
+	  const boost::shared_ptr<MutatableImageComputerTask> task
+	    (
+	     new MutatableImageComputerTask
+	     (
+	      this,
+	      _image_function,
+	      boost::shared_ptr<MutatableImageComputerBuffer>(new MutatableImageComputerBuffer(probe_size,1,1,probe_size,QSize())),
+	      0,
+	      QSize(0,0),
+	      probe_size,
+	      0,
+	      0,
+	      1,
+	      false,
+	      1,
+	      _serial,
+	      _generation,
+	      true,
+	      !_full_functionality,
+	      MutatableImage::HeatmapNone
+	      )
+	     );
+	  farm().push_todo(task);
+	}
+      else
+	{
+	  push_render_tasks(one_of_many);
+	}
+    }
+}
+
+//! Size of the tiles big scrollable images are rendered in at full resolution.
+static const int tile_size=256;
+
+//! Estimated seconds per sample of a typical image: a sample of an image this costly counts one towards task priority.
+static const real typical_sample_seconds=1e-6;
+
+//! Images whose first full resolution pass is estimated to take less than this don't bother with coarser levels.
+static const real cheap_image_seconds=0.01;
+
+//! Fragments are sized to take about this long (as estimated), within the limits set by the number of threads.
+static const real fragment_seconds=0.05;
+
+uint MutatableImageDisplay::cost_priority(real samples) const
+{
+  const real priority=samples*_image_function->cost()/typical_sample_seconds;
+  // Headroom for the tile distances added to _tiled_priority
+  return static_cast<uint>(std::max(1.0,std::min(priority,1e9)));
+}
+
+void MutatableImageDisplay::push_render_tasks(bool one_of_many,int coarsest_level,uint multisample_done)
+{
+  // Queued all at once at the end
+  std::vector<boost::shared_ptr<MutatableImageComputerTask> > tasks;
+
+  _tiled_buffer.reset();
+
+  const real sample_seconds=_image_function->cost()*_frames;
+  if (sample_seconds*image_size().width()*image_size().height()<cheap_image_seconds) coarsest_level=0;
+
+  // Allow for displays up to 4096 pixels high or wide
+  for (int level=coarsest_level;level>=0;level--)
+    {
+      const int s=(1<<level);
+      const QSize render_size(image_size()/s);
+
+      // Don't bother rendering anything less than 4x4 unless that's all there is
+      if ((render_size.width()>=4 && render_size.height()>=4) || level==0)
+	{
+	  std::vector<uint> multisample_grid;
+	  multisample_grid.push_back(1);
+	  if (level==0)
 	    {
-	      const int fragments
-		=(
-		  one_of_many
-		  ?
-		  1
-		  :
-		  std::min
-		  (
-		   2*farm().num_threads(),
-		   static_cast<uint>(render_size.height())
-		   )
-		  );
-	      
-	      std::vector<uint> multisample_grid;
-	      multisample_grid.push_back(1);
-	      if (level==0)
+	      // Only the final full resolution level gets an additional multisampling task.
+	      // For 4x4 sampling, do an initial 2x2 too.
+	      if (main().render_parameters().multisample_grid()==4) multisample_grid.push_back(2);
+	      if (main().render_parameters().multisample_grid()>1) multisample_grid.push_back(main().render_parameters().multisample_grid());
+	    }
+
+	  for (std::vector<uint>::const_iterator multisample_it=multisample_grid.begin();multisample_it!=multisample_grid.end();multisample_it++)
+	    {
+	      if (level==0 && (*multisample_it)<=multisample_done) continue;
+
+	      //! \todo Should computed animation frames be constant or reduced c.f spatial resolution ?  (Do full z resolution for now)
+	      const boost::shared_ptr<const MutatableImage> task_image(_image_function);
+	      assert(task_image->ok());
+
+	      // Use number of samples in unfragmented image, weighted by their cost, as priority
+	      const real samples=static_cast<real>(render_size.width())*render_size.height()*(*multisample_it)*(*multisample_it);
+	      const uint task_priority=cost_priority(samples);
+
+	      // Enough fragments to keep each to about fragment_seconds, up to two per thread
+	      // (or one per thread if lots of other displays are being updated too: they'll keep the rest busy)
+	      const uint max_fragments=(one_of_many ? 1 : 2)*farm().num_threads();
+	      const int fragments=std::max
+		(
+		 1,
+		 std::min
+		 (
+		  render_size.height(),
+		  static_cast<int>(std::min(static_cast<real>(max_fragments),ceil(samples*sample_seconds/fragment_seconds)))
+		  )
+		 );
+
+	      // If only part of the image can be seen (scrollable), the first full resolution pass is done in tiles,
+	      // so the visible part can be done first.
+	      const bool tiled=(_fixed_size && level==0 && (*multisample_it)==1 && (render_size.width()>tile_size || render_size.height()>tile_size));
+	      const int tiles=((render_size.width()+tile_size-1)/tile_size)*((render_size.height()+tile_size-1)/tile_size);
+
+	      // All the fragments render into the same buffer, which is complete when they all are.
+	      // For an icon, take the first image big enough to (hopefully) be filtered down nicely.
+	      const QSize icon_size(32,32);
+	      const bool icon=(level==0 || (render_size.width()>=2*icon_size.width() && render_size.height()>=2*icon_size.height()));
+	      const boost::shared_ptr<MutatableImageComputerBuffer> buffer
+		(
+		 new MutatableImageComputerBuffer(render_size,_frames,(tiled ? tiles : fragments),image_size(),(icon ? icon_size : QSize()))
+		 );
+
+	      if (tiled)
 		{
-		  // Only the final full resolution level gets an additional multisampling task.
-		  // For 4x4 sampling, do an initial 2x2 too.
-		  if (main().render_parameters().multisample_grid()==4) multisample_grid.push_back(2);
-		  if (main().render_parameters().multisample_grid()>1) multisample_grid.push_back(main().render_parameters().multisample_grid());
+		  _tiled_buffer=buffer;
+		  _tiled_priority=task_priority;
+		  push_tile_tasks(tasks);
+		  continue;
 		}
 
-	      for (std::vector<uint>::const_iterator multisample_it=multisample_grid.begin();multisample_it!=multisample_grid.end();multisample_it++)
+	      int fragment_start_row=0;
+	      for (int f=0;f<fragments;f++)
 		{
-		  //! \todo Should computed animation frames be constant or reduced c.f spatial resolution ?  (Do full z resolution for now)
-		  const boost::shared_ptr<const MutatableImage> task_image(_image_function);
-		  assert(task_image->ok());
-		  
-		  // Use number of samples in unfragmented image as priority
-		  const uint task_priority=render_size.width()*render_size.height()*(*multisample_it)*(*multisample_it);
-		  
-		  int fragment_start_row=0;
-		  for (int f=0;f<fragments;f++)
-		    {
-		      const int fragment_end_row=(render_size.height()*(f+1))/fragments;
-		      const boost::shared_ptr<MutatableImageComputerTask> task
-			(
-			 new MutatableImageComputerTask
-			 (
-			  this,
-			  task_image,
-			  task_priority,
-			  QSize(0,fragment_start_row),
-			  QSize(render_size.width(),fragment_end_row-fragment_start_row),
-			  render_size,
-			  _frames,
-			  level,
-			  f,
-			  fragments,
-			  main().render_parameters().jittered_samples(),
-			  (*multisample_it),
-			  _serial
-			  )
-			 );
-		      farm().push_todo(task);
-		      fragment_start_row=fragment_end_row;
-		    }
+		  const int fragment_end_row=(render_size.height()*(f+1))/fragments;
+		  const boost::shared_ptr<MutatableImageComputerTask> task
+		    (
+		     new MutatableImageComputerTask
+		     (
+		      this,
+		      task_image,
+		      buffer,
+		      task_priority,
+		      QSize(0,fragment_start_row),
+		      QSize(render_size.width(),fragment_end_row-fragment_start_row),
+		      level,
+		      f,
+		      fragments,
+		      main().render_parameters().jittered_samples(),
+		      (*multisample_it),
+		      _serial,
+		      _generation,
+		      false,
+		      !_full_functionality,
+		      _heatmap
+		      )
+		     );
+		  tasks.push_back(task);
+		  fragment_start_row=fragment_end_row;
 		}
 	    }
 	}
     }
+
+  farm().push_todo(tasks);
+}
+
+const QRect MutatableImageDisplay::tile_rect(uint tile) const
+{
+  const int tiles_across=(_tiled_buffer->size().width()+tile_size-1)/tile_size;
+  const QPoint origin(tile_size*(tile%tiles_across),tile_size*(tile/tiles_across));
+  return QRect(origin,QSize(std::min(tile_size,_tiled_buffer->size().width()-origin.x()),std::min(tile_size,_tiled_buffer->size().height()-origin.y())));
+}
+
+void MutatableImageDisplay::push_tile_tasks(std::vector<boost::shared_ptr<MutatableImageComputerTask> >& tasks)
+{
+  const QSize& size=_tiled_buffer->size();
+  const uint tiles=((size.width()+tile_size-1)/tile_size)*((size.height()+tile_size-1)/tile_size);
+
+  // The display is the full size image, so the visible part of it is what's in view in the scroll area.
+  const QRect visible(visibleRegion().boundingRect());
+  const QPoint centre(visible.isEmpty() ? rect().center() : visible.center());
+
+  for (uint t=0;t<tiles;t++)
+    {
+      if (_tiled_buffer->fragment_done(t)) continue;
+
+      const QRect r(tile_rect(t));
+      tasks.push_back
+	(
+	 boost::shared_ptr<MutatableImageComputerTask>
+	 (
+	  new MutatableImageComputerTask
+	  (
+	   this,
+	   _image_function,
+	   _tiled_buffer,
+	   _tiled_priority+(r.center()-centre).manhattanLength(),
+	   QSize(r.x(),r.y()),
+	   r.size(),
+	   0,
+	   t,
+	   tiles,
+	   main().render_parameters().jittered_samples(),
+	   1,
+	   _serial,
+	   _generation,
+	   false,
+	   !_full_functionality,
+	   _heatmap
+	   )
+	  )
+	 );
+    }
+}
+
+/*! Tiles already queued are left where they are: whichever copy of a tile gets computed first does it,
+  and the other is skipped (see MutatableImageComputerTask::redundant).
+ */
+void MutatableImageDisplay::retile()
+{
+  if (!_tiled_buffer || _tiled_buffer->completed()) return;
+
+  std::vector<boost::shared_ptr<MutatableImageComputerTask> > tasks;
+  push_tile_tasks(tasks);
+  farm().push_todo(tasks);
+}
+
+void MutatableImageDisplay::moveEvent(QMoveEvent*)
+{
+  if (_tiled_buffer) _tile_timer->start(250);
+}
+
+/*! For a plane, panning is just a shift of the pixels (sample jitter aside, which is keyed on pixel position),
+  and a magnified image is a fair likeness of a zoomed one, so the coarse levels needn't be computed at all.
+ */
+void MutatableImageDisplay::adjust()
+{
+  if (_adjust_kind==AdjustNone) return;
+
+  const AdjustKind kind=_adjust_kind;
+  const QPoint pan=_adjust_pan;
+  const real zoom=_adjust_zoom;
+
+  std::auto_ptr<FunctionTop> new_root(image_function()->top().typed_deepclone());
+  new_root->concatenate_pretransform_on_right(_adjust_transform);
+  const boost::shared_ptr<const MutatableImage> new_image_function(new MutatableImage(new_root,image_function()->sinusoidal_z(),image_function()->spheremap(),false));
+
+  _probing=false;
+  _probe_parent.reset();
+
+  if (kind==AdjustPan && adjust_pan(new_image_function,pan))
+    {}
+  else if ((kind==AdjustPan || kind==AdjustZoom) && !new_image_function->spheremap())
+    {
+      adjust_placeholder(zoom,pan);
+      load(new_image_function,false,false);
+      push_render_tasks(false,2);
+    }
+  else
+    {
+      load(new_image_function,false);
+    }
+
+  _adjust_in_flight=true;
+}
+
+bool MutatableImageDisplay::adjust_pan(const boost::shared_ptr<const MutatableImage>& image_fn,const QPoint& pan)
+{
+  // Only full resolution pixels are worth keeping.
+  const int w=image_size().width();
+  const int h=image_size().height();
+  if (
+      image_fn->spheremap()
+      || pan.isNull()
+      || abs(pan.x())>=w
+      || abs(pan.y())>=h
+      || _current_display_level!=0
+      || _offscreen_images.size()!=_frames
+      )
+    return false;
+  for (uint f=0;f<_frames;f++)
+    if (_offscreen_images[f].size()!=image_size()) return false;
+
+  // Newly exposed areas are black until computed.
+  std::vector<QImage> shifted;
+  for (uint f=0;f<_frames;f++)
+    shifted.push_back(_offscreen_images[f].copy(QRect(-pan.x(),-pan.y(),w,h)));
+
+  const uint multisample=_current_display_multisample_grid;
+
+  load(image_fn,false,false);
+
+  // Exposed rows right across, and exposed columns in the rest of the height.
+  std::vector<QRect> strips;
+  const QRect rows(0,(pan.y()>0 ? 0 : h+pan.y()),w,abs(pan.y()));
+  const QRect cols((pan.x()>0 ? 0 : w+pan.x()),(pan.y()>0 ? pan.y() : 0),abs(pan.x()),h-abs(pan.y()));
+  if (!rows.isEmpty()) strips.push_back(rows);
+  if (!cols.isEmpty()) strips.push_back(cols);
+
+  const boost::shared_ptr<MutatableImageComputerBuffer> buffer
+    (
+     new MutatableImageComputerBuffer(image_size(),_frames,strips.size(),image_size(),QSize())
+     );
+  buffer->seed(shifted);
+
+  _offscreen_images=shifted;
+  _offscreen_display_images=shifted;
+  charge_memory();
+  update();
+
+  std::vector<boost::shared_ptr<MutatableImageComputerTask> > tasks;
+  for (uint s=0;s<strips.size();s++)
+    {
+      tasks.push_back
+	(
+	 boost::shared_ptr<MutatableImageComputerTask>
+	 (
+	  new MutatableImageComputerTask
+	  (
+	   this,
+	   _image_function,
+	   buffer,
+	   cost_priority(static_cast<real>(strips[s].width())*strips[s].height()*multisample*multisample),
+	   QSize(strips[s].x(),strips[s].y()),
+	   strips[s].size(),
+	   0,
+	   s,
+	   strips.size(),
+	   main().render_parameters().jittered_samples(),
+	   multisample,
+	   _serial,
+	   _generation,
+	   false,
+	   !_full_functionality,
+	   _heatmap
+	   )
+	  )
+	 );
+    }
+  farm().push_todo(tasks);
+
+  // Any finer multisampling still to come is done over the whole image as usual.
+  push_render_tasks(false,0,multisample);
+
+  return true;
+}
+
+void MutatableImageDisplay::adjust_placeholder(real zoom,const QPoint& pan)
+{
+  // Beyond this the placeholder's not much like the result.
+  if (zoom<1.0/16.0 || zoom>16.0) return;
+
+  for (uint f=0;f<_offscreen_display_images.size();f++)
+    {
+      const QImage& image=_offscreen_display_images[f];
+      if (image.isNull()) continue;
+
+      const QSize magnified(lrint(image.width()*zoom),lrint(image.height()*zoom));
+      if (magnified.isEmpty()) continue;
+
+      // Areas outside the magnified image come out black.
+      _offscreen_display_images[f]=image.scaled(magnified).copy
+	(
+	 QRect
+	 (
+	  (magnified.width()-image.width())/2-pan.x(),
+	  (magnified.height()-image.height())/2-pan.y(),
+	  image.width(),
+	  image.height()
+	  )
+	 );
+    }
+  charge_memory();
+  update();
 }
 
 void MutatableImageDisplay::deliver(const boost::shared_ptr<const MutatableImageComputerTask>& task)
 {
+  if (task->probe())
+    {
+      if (!task->aborted() && task->serial()==_serial && _probing)
+	probe_delivered(task);
+      return;
+    }
+
   // Ignore tasks which were aborted or which have somehow got out of order 
   // (entirely possible with multiple compute threads).
   if (
@@ -355,78 +736,85 @@ void MutatableImageDisplay::deliver(const boost::shared_ptr<const MutatableImage
       )
     return;
 
-  // Record the fragment in the inbox
-  const OffscreenImageInbox::key_type inbox_key(task->level(),task->multisample_grid());  
-  OffscreenImageInbox::mapped_type& inbox_level=_offscreen_images_inbox[inbox_key];
-  assert(inbox_level.find(task->fragment())==inbox_level.end());
-  inbox_level[task->fragment()]=task;
-  
-  if (inbox_level.size()!=task->number_of_fragments())
-    return;
-
-  // If the level is complete, we can proceed to displaying it
-
-  // Note that obsolete levels will never complete once a better one is displayed.
-  // So clear up previous levels; they're now irrelevant
-  _offscreen_images_inbox.erase
-    (
-     _offscreen_images_inbox.upper_bound(inbox_key),  // upper_bound is the NEXT key from the one we're about to display
-     _offscreen_images_inbox.end()
-     );
-  
-  const QSize render_size(task->whole_image_size());
-  
-  if (task->number_of_fragments()==1)
+  // Tiles are painted as they arrive (see paintEvent)
+  if (task->buffer()==_tiled_buffer && !_tiled_buffer->completed())
     {
-      // If there's only one fragment in the task, just use it
-      _offscreen_images=task->images();
-    }
-  else
-    {
-      // Otherwise we need to assemble the fragments together
-      _offscreen_images.resize(0);
-      for (uint f=0;f<_frames;f++)
-	{
-	  _offscreen_images.push_back(QImage(render_size,QImage::Format_RGB32));
-	  
-	  for (OffscreenImageInbox::mapped_type::const_iterator it=inbox_level.begin();it!=inbox_level.end();++it)
-	    {
-	      QPainter painter(&_offscreen_images.back());
-	      painter.drawImage
-		(
-		 QPoint((*it).second->fragment_origin().width(),(*it).second->fragment_origin().height()),
-		 (*it).second->images()[f]
-		 );
-	    }
-	}
+      update(tile_rect(task->fragment()));
+      return;
     }
-  
-  for (uint f=0;f<_frames;f++)
+
+  // Wait for the rest of the fragments sharing the buffer.
+  // Whichever of them is delivered first after the last one completes displays it;
+  // the others are then dropped as not being an improvement.
+  if (!task->buffer()->completed())
+    return;
+
+  // An antialiased rendering which had to be downgraded is worse than the single sample one already shown, so keep that.
+  const bool downgraded=task->buffer()->downgraded();
+  if (downgraded && _current_display_level==0 && task->multisample_grid()>1)
     {
-      //! \todo Pick a scaling mode: Qt::SmoothTransformation vs Qt::FastTransformation (default) (and put it under GUI control). 
-      //! \todo Expose dither mode control: Qt::DiffuseDither vs Qt::ThresholdDither
-      _offscreen_pixmaps[f]=QPixmap::fromImage(_offscreen_images[f].scaled(image_size()),(Qt::ColorOnly|Qt::ThresholdDither));
+      _current_display_multisample_grid=task->multisample_grid();
+      if (task->buffer()==_tiled_buffer) _tiled_buffer.reset();
+      _downgraded=true;
+      update();
+      return;
     }
+
+  // The buffer is complete and no longer written to, so its images can be shared as they are.
+  // Scaling was already done by the compute thread; just swap in the results.
+  _offscreen_images=task->buffer()->images();
+  _offscreen_display_images=task->buffer()->display_images();
+  if (task->buffer()==_tiled_buffer) _tiled_buffer.reset();
+
+  if (_current_display_level==static_cast<uint>(-1))
+    main().first_pixels_delivered(_load_time.elapsed());
   
   //! Note the resolution we've displayed so out-of-order low resolution images are dropped
   _current_display_level=task->level();
   _current_display_multisample_grid=task->multisample_grid();
+  _downgraded=downgraded;
   
-  // For an icon, take the first image big enough to (hopefully) be filtered down nicely.
   // The (Qt3) converter seems to auto-create an alpha mask sometimes (images with const-color areas), which is quite cool.
-  const QSize icon_size(32,32);
-  if (task->serial()!=_icon_serial && (task->level()==0 || (render_size.width()>=2*icon_size.width() && render_size.height()>=2*icon_size.height())))
+  if (task->serial()!=_icon_serial && !task->buffer()->icon_image().isNull())
     {
-      const QImage icon_image(_offscreen_images[_offscreen_images.size()/2].scaled(icon_size));
-      
-      if (!_icon.get()) _icon=std::auto_ptr<QPixmap>(new QPixmap(icon_size));
-      (*_icon)=QPixmap::fromImage(icon_image,Qt::ColorOnly);
+      if (!_icon.get()) _icon=std::auto_ptr<QPixmap>(new QPixmap(task->buffer()->icon_image().size()));
+      (*_icon)=QPixmap::fromImage(task->buffer()->icon_image(),Qt::ColorOnly);
       
       _icon_serial=task->serial();
     }
+  charge_memory();
 
   // Update what's on the screen.
   update();
+
+  // The last mid-button adjustment has something to show now, so any accumulated since can go.
+  if (_adjust_in_flight)
+    {
+      _adjust_in_flight=false;
+      adjust();
+    }
+}
+
+void MutatableImageDisplay::probe_delivered(const boost::shared_ptr<const MutatableImageComputerTask>& task)
+{
+  // Give up after this many rejections and just render whatever we've got (the threshold might be unachievable).
+  const uint max_probe_attempts=16;
+
+  const real score=main().probe_score()(task->buffer()->images()[0]);
+  const bool accepted=(score>=main().mutation_parameters().probe_threshold());
+  main().probe_reported(accepted);
+
+  if (accepted || _probe_attempts>=max_probe_attempts)
+    {
+      _probing=false;
+      _probe_parent.reset();
+      push_render_tasks(_probe_one_of_many);
+    }
+  else
+    {
+      _probe_attempts++;
+      load(main().probe_replacement(_probe_parent),_probe_one_of_many);
+    }
 }
 
 void MutatableImageDisplay::lock(bool l,bool record_in_history)
@@ -450,54 +838,168 @@ void MutatableImageDisplay::lock(bool l,bool record_in_history)
   _menu_item_action_lock->setChecked(l);
 }
 
+/*! Counting evaluations is switched on for everyone the first time it's wanted, and left on (it's cheap).
+ */
+void MutatableImageDisplay::heatmap(MutatableImage::Heatmap h)
+{
+  for (uint i=0;i<3;i++)
+    _menu_item_action_heatmap[i]->setChecked(static_cast<uint>(h)==i);
+
+  if (h==_heatmap) return;
+  _heatmap=h;
+
+  if (_heatmap==MutatableImage::HeatmapEvaluations)
+    FunctionProfile::count(true);
+
+  // Same image, so this just starts rendering it again.
+  if (_image_function) image_function(_image_function,false);
+}
+
 /*! Enlargements are implied by a non-full-functionality displays.
  */
 MutatableImageComputerFarm& MutatableImageDisplay::farm() const
 {
-  return main().farm(!_full_functionality);
+  return main().farm();
+}
+
+/*! Just moves us on to a new generation: nothing is scanned or locked.
+  Queued tasks are dropped when next popped by a compute thread or the GUI,
+  and a compute thread part way through one of our tasks notices within a pixel.
+ */
+void MutatableImageDisplay::abort_tasks()
+{
+  _generation->ref();
+}
+
+/*! Display images the same as the rendered ones (the usual case, unless the display's been resized) share their data, so aren't counted again.
+ */
+void MutatableImageDisplay::charge_memory()
+{
+  size_t bytes=(_icon.get() ? 4*_icon->width()*_icon->height() : 0);
+  for (uint f=0;f<_offscreen_images.size();f++)
+    bytes+=_offscreen_images[f].byteCount();
+  for (uint f=0;f<_offscreen_display_images.size();f++)
+    if (f>=_offscreen_images.size() || _offscreen_display_images[f].cacheKey()!=_offscreen_images[f].cacheKey())
+      bytes+=_offscreen_display_images[f].byteCount();
+  _memory.set(bytes);
+}
+
+/*! Minimised windows and displays scrolled out of view count as unseen.
+  The icon is kept: it's small, and could be in use as the main window's.
+ */
+bool MutatableImageDisplay::release_images()
+{
+  if (_released || !_image_function || (!window()->isMinimized() && !visibleRegion().isEmpty()))
+    return false;
+
+  bool released=!_offscreen_images.empty();
+  for (uint f=0;f<_offscreen_display_images.size();f++)
+    {
+      released=(released || !_offscreen_display_images[f].isNull());
+      _offscreen_display_images[f]=QImage();
+    }
+  if (!released) return false;
+
+  // Anything still computing would only bring the memory back.
+  abort_tasks();
+  _tiled_buffer.reset();
+
+  _offscreen_images.clear();
+  _current_display_level=static_cast<uint>(-1);
+  _current_display_multisample_grid=static_cast<uint>(-1);
+  _released=true;
+  charge_memory();
+  return true;
 }
 
 void MutatableImageDisplay::paintEvent(QPaintEvent*)
 {
-  // Repaint the screen from the offscreen pixmaps
+  // Visible again: render from scratch, as after a resize.
+  if (_released)
+    {
+      _released=false;
+      _resize_timer->start(0);
+    }
+
+  // Repaint the screen from the offscreen images
   QPainter painter(this);
-  painter.drawPixmap(0,0,_offscreen_pixmaps[_current_frame]);
+  const QImage& image=_offscreen_display_images[_current_frame];
+  if (image.isNull())
+    painter.fillRect(rect(),Qt::black);
+  else
+    painter.drawImage(0,0,image);
 
-  // If this is the first paint event after a resize we can start computing images for the new size.
-  if (_resize_in_progress)
+  // Full resolution tiles done so far
+  if (_tiled_buffer)
     {
-      image_function(_image_function,false);  // A resize should really be considered one-of-many, but because the image doesn't change we seem to be able to get away with it
-      _resize_in_progress=false;
+      const uint tiles=_tiled_buffer->fragments();
+      for (uint t=0;t<tiles;t++)
+	{
+	  if (_tiled_buffer->fragment_done(t))
+	    {
+	      const QRect r(tile_rect(t));
+	      painter.drawImage(r,_tiled_buffer->partial_images()[_current_frame],r);
+	    }
+	}
     }
+
+  // Flag images which aren't all they should be because rendering them overran the task budget.
+  if (_downgraded)
+    painter.fillRect(width()-6,0,6,6,Qt::yellow);
 }
 
-/*! In the resize event we just focus on shutting down existing compute threads
-  because they'll all have to be restarted.
-  NB Multiple resize events can be received before a repaint occurs.
-  NB There's nothing to be done for fixed size images (not even setting _resize_in_progress).
+/*! In the resize event we just shut down existing compute tasks, because they'll all have to be restarted,
+  and show the current image rescaled to the new size.
+  Recomputing waits until resizing has been quiet for a moment (see resized).
+  NB There's nothing to be done for fixed size images.
  */
 void MutatableImageDisplay::resizeEvent(QResizeEvent* event)
 {
-  // Fixed size images don't need anything doing here.  We don't even set _resize_in_progress.
-  if (!_fixed_size)
+  // Fixed size images don't need anything doing here.
+  // Nor does a resize to the size we've already got (the pixels are still right).
+  if (!_fixed_size && event->size()!=_image_size)
     {
       _image_size=event->size();
       
       // Abort all current tasks because they'll be the wrong size.
-      farm().abort_for(this);
+      abort_tasks();
       
-      // Resize and reset our offscreen pixmap (something to do while we wait)
-      for (uint f=0;f<_offscreen_pixmaps.size();f++)
+      // Rescale from the images as rendered, so repeated resizes don't compound the degradation.
+      bool placeholder=false;
+      for (uint f=0;f<_offscreen_display_images.size();f++)
 	{
-	  _offscreen_pixmaps[f]=QPixmap(image_size()); 
-	  _offscreen_pixmaps[f].fill(QColor(0,0,0));           
+	  if (_offscreen_display_images[f].isNull()) continue;
+	  const QImage& source=(f<_offscreen_images.size() && !_offscreen_images[f].isNull() ? _offscreen_images[f] : _offscreen_display_images[f]);
+	  _offscreen_display_images[f]=source.scaled(_image_size);
+	  placeholder=true;
 	}
-      
-      // Flag for the next paintEvent to tell it a recompute can be started now.
-      _resize_in_progress=true;
+      charge_memory();
+      update();
+
+      // With nothing to look at meanwhile (e.g the initial layout) there's no point waiting,
+      // but a zero timeout still coalesces resizes arriving together.
+      _resize_timer->start(placeholder ? 200 : 0);
     }
 }
 
+/*! The rescaled image already on display stands in for the coarsest levels, so they're skipped.
+ */
+void MutatableImageDisplay::resized()
+{
+  // The resize aborted any probe in flight: queue it again at the new size, so the candidate is still scored before rendering properly.
+  if (_probing)
+    {
+      load(_image_function,_probe_one_of_many);
+      return;
+    }
+
+  const bool placeholder=!_offscreen_display_images[_current_frame].isNull();
+
+  // A resize should really be considered one-of-many, but because the image doesn't change we seem to be able to get away with it
+  load(_image_function,false,false);
+  if (_image_function) push_render_tasks(false,(placeholder ? 2 : 12));
+}
+
 void MutatableImageDisplay::mousePressEvent(QMouseEvent* event)
 {
   if (event->button()==Qt::RightButton)
@@ -536,6 +1038,8 @@ void MutatableImageDisplay::mouseMoveEvent(QMouseEvent* event)
 	  
 	  // Build the transform caused by the adjustment
 	  Transform transform=TransformIdentity();
+	  AdjustKind kind=AdjustOther;
+	  real zoom=1.0;
 	  
 	  // Shift button (no ctrl) is various zooms
 	  if (event->modifiers()&Qt::ShiftModifier && !(event->modifiers()&Qt::ControlModifier))
@@ -578,6 +1082,8 @@ void MutatableImageDisplay::mouseMoveEvent(QMouseEvent* event)
 		  const real radius=sqrt(dx*dx+dy*dy);
 		  const real last_radius=sqrt(last_dx*last_dx+last_dy*last_dy);
 		  
+		  kind=AdjustZoom;
+
 		  // Only scale in non-degenerate cases
 		  if (radius!=0.0 && last_radius!=0.0)
 		    {
@@ -585,6 +1091,8 @@ void MutatableImageDisplay::mouseMoveEvent(QMouseEvent* event)
 		      transform.basis_x(XYZ(1.0/scale,          0.0,0.0));
 		      transform.basis_y(XYZ(      0.0,1.0/scale,0.0));
 		      
+		      zoom=scale;
+
 		      std::clog << "[Isotropic scale]";
 		    }
 		}
@@ -640,16 +1148,22 @@ void MutatableImageDisplay::mouseMoveEvent(QMouseEvent* event)
 			    0.0
 			    );
 	      transform.translate(translate);
+	      kind=AdjustPan;
 	      
 	      std::clog << "[Pan]";
 	    }
-	  
-	  std::auto_ptr<FunctionTop> new_root(image_function()->top().typed_deepclone());
-	  new_root->concatenate_pretransform_on_right(transform);
 
-	  // Install new image (triggers recompute).
-	  const boost::shared_ptr<const MutatableImage> new_image_function(new MutatableImage(new_root,image_function()->sinusoidal_z(),image_function()->spheremap(),false));
-	  image_function(new_image_function,false);
+	  // Accumulate with any adjustments still waiting for the last one's pixels.
+	  _adjust_transform.concatenate_on_right(transform);
+	  if (_adjust_kind==AdjustNone)
+	    _adjust_kind=kind;
+	  else if (_adjust_kind!=kind)
+	    _adjust_kind=AdjustOther;
+	  if (kind==AdjustPan) _adjust_pan+=pixel_delta;
+	  if (kind==AdjustZoom) _adjust_zoom*=zoom;
+
+	  // Install new image (triggers recompute), unless the last one's still in flight, in which case deliver does it.
+	  if (!_adjust_in_flight) adjust();
 
 	  // Finally, record position of this event as last event
 	  _mid_button_adjust_last_pos=event->pos();
@@ -748,6 +1262,21 @@ void MutatableImageDisplay::menupick_simplify()
 {
   simplify_constants(true);
 }
+
+void MutatableImageDisplay::menupick_heatmap_off()
+{
+  heatmap(MutatableImage::HeatmapNone);
+}
+
+void MutatableImageDisplay::menupick_heatmap_evaluations()
+{
+  heatmap(MutatableImage::HeatmapEvaluations);
+}
+
+void MutatableImageDisplay::menupick_heatmap_time()
+{
+  heatmap(MutatableImage::HeatmapTime);
+}
  
 
 /*! Saves image (unless the image is not full resolution yet, in which case an informative dialog is generated.
@@ -989,7 +1518,13 @@ void MutatableImageDisplay::menupick_properties()
   std::stringstream xml;
   image_function()->save_function(xml);
 
-  _properties->set_content(msg.str(),xml.str());
+  std::stringstream profile;
+  if (FunctionProfile::enabled())
+    FunctionProfile::report(profile,image_function()->top());
+  else
+    profile << "Function evaluation profiling is off.\nStart evolvotron with the --profile option to turn it on.\n";
+
+  _properties->set_content(msg.str(),xml.str(),profile.str());
   if (_icon.get()) _properties->setWindowIcon(*_icon);
   _properties->exec();
 }
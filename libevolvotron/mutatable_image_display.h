@@ -27,8 +27,10 @@
 #include "mutatable_image.h"
 #include "mutatable_image_computer.h"
 #include "dialog_mutatable_image_display.h"
+#include "transform.h"
 
 class EvolvotronMain;
+class MutatableImageComputerBuffer;
 class MutatableImageComputerTask;
 
 //! Widget responsible for displaying a MutatableImage.
@@ -69,10 +71,8 @@ class MutatableImageDisplay : public QWidget
   //! Timer for animating frames
   QTimer* _timer;
 
-  //! Flag indicating resize is in progress (between resizeEvent and subsequent paintEvent).
-  /*! Used to supress unnecessary task spawning.
-   */
-  bool _resize_in_progress;
+  //! Debounces recomputing after a resize, so dragging a window edge doesn't flood the farm with tasks soon thrown away.
+  QTimer* _resize_timer;
 
   //! The resolution level currently displaying (0=1-for-1 pixels, 1=half resolution etc).
   /*! Needed to handle possible out of order task returns from multiple compute threads.
@@ -82,27 +82,41 @@ class MutatableImageDisplay : public QWidget
   //! Similar to _current_display_level, but for tracking multisample grids within a resolution level.
   uint _current_display_multisample_grid;
 
+  //! Started when an image is loaded, for measuring time to the first pixels being displayed.
+  QTime _load_time;
+
+  //! Full resolution rendering being done in tiles, those nearest the visible area first.
+  /*! Only for (scrollable) fixed size displays too big for a single tile; null otherwise, or once complete.
+    Completed tiles are painted as they arrive.
+   */
+  boost::shared_ptr<MutatableImageComputerBuffer> _tiled_buffer;
+
+  //! Priority of the full resolution level; tiles' priorities are this plus their distance from the visible area.
+  uint _tiled_priority;
+
+  //! Debounces requeueing tiles while scrolling.
+  QTimer* _tile_timer;
+
   //! An image suitable for setting as an icon.
   std::auto_ptr<QPixmap> _icon;
 
   //! Track which image the icon is actually of.
   unsigned long long int _icon_serial;
 
-  //! Offscreen image buffer.
-  std::vector<QPixmap> _offscreen_pixmaps;
+  //! Images as displayed (scaled to the display size by the compute thread).  Null images paint as black.
+  std::vector<QImage> _offscreen_display_images;
 
-  //! Offscreen image buffer in sensible image format (used for save, as pixmap is in display format which might be less bits).
+  //! Images at the resolution they were rendered at (used for save).
   std::vector<QImage> _offscreen_images;
 
-  //! Type for staging area for incoming fragments.
-  /*! Key is level and multisampling, mapped type is also itself a map from fragment number to tasks.
-   */
-  typedef std::map<std::pair<uint,uint>,std::map<uint,boost::shared_ptr<const MutatableImageComputerTask> > > OffscreenImageInbox;
+  //! Accounts for the images (and icon).
+  MemoryAccount::Charge _memory;
 
-  //! Staging area for incoming fragments.
-  /*! Fragments are accumulated for each (level,multisample) key, and completed levels passed on for display
-   */
-  OffscreenImageInbox _offscreen_images_inbox;
+  //! Whether the images were released to save memory (see release_images), and need recomputing when next painted.
+  bool _released;
+
+  //! Whether the image shown was rendered coarser than asked for (or not antialiased) because it overran the farm's task budget.
+  bool _downgraded;
 
   //! The image function being displayed (its root node).
   /*! The held image is const because references to it could be held by history archive, compute tasks etc,
@@ -127,15 +141,59 @@ class MutatableImageDisplay : public QWidget
    */
   QAction* _menu_item_action_lock;
 
+  //! Submenu for heatmap options.
+  QMenu* _menu_heatmap;
+
+  //! Heatmap menu items, indexed by MutatableImage::Heatmap (for their check-marks).
+  QAction* _menu_item_action_heatmap[3];
+
+  //! What the display is showing a heatmap of, if anything.
+  MutatableImage::Heatmap _heatmap;
+
   //! Coordinate of mouse event which started mid-button adjustment
   QPoint _mid_button_adjust_start_pos;
 
   //! Coordinate of last mouse event when mid-button adjusting
   QPoint _mid_button_adjust_last_pos;
 
+  //! What the mid-button adjustments waiting to be applied amount to, as far as reusing already computed pixels goes.
+  enum AdjustKind {AdjustNone,AdjustPan,AdjustZoom,AdjustOther};
+
+  //! Kind of the mid-button adjustments waiting to be applied (AdjustNone if there are none).
+  AdjustKind _adjust_kind;
+
+  //! Mid-button adjustments waiting to be applied, all concatenated.
+  Transform _adjust_transform;
+
+  //! For pans, how far the image is to move in pixels.
+  QPoint _adjust_pan;
+
+  //! For isotropic zooms, how much the image is to be magnified.
+  real _adjust_zoom;
+
+  //! Whether the last mid-button adjustment is still waiting for its first pixels.
+  /*! Motion events arriving meanwhile are accumulated, so only one recompute is in flight at a time.
+   */
+  bool _adjust_in_flight;
+
   //! Serial number to kill some rare problems with out-of-order tasks being returned
   unsigned long long int _serial;
 
+  //! Generation counter shared with our compute tasks.  Incrementing it aborts all of them (see abort_tasks).
+  const boost::shared_ptr<QAtomicInt> _generation;
+
+  //! Whether the current image is waiting on a probe render before being rendered properly.
+  bool _probing;
+
+  //! Image the current image was mutated from, which will be mutated again if the probe rejects it (null for new random images).
+  boost::shared_ptr<const MutatableImage> _probe_parent;
+
+  //! Number of images already rejected by the probe for this display since the last image_function_probed.
+  uint _probe_attempts;
+
+  //! Fragmentation strategy to use for the full render once the probe accepts an image.
+  bool _probe_one_of_many;
+
  public:
   //! Constructor.  
   MutatableImageDisplay(EvolvotronMain* mn,bool full_functionality,bool fixed_size,const QSize& image_size,uint f,uint fr);
@@ -174,29 +232,94 @@ class MutatableImageDisplay : public QWidget
       return _image_size;
     }
 
+  //! Resolution level on display (0 is full resolution; -1 if nothing since the last load).
+  uint current_display_level() const
+    {
+      return _current_display_level;
+    }
+
+  //! Multisampling grid of the image on display.
+  uint current_display_multisample_grid() const
+    {
+      return _current_display_multisample_grid;
+    }
+
   //! Load a new image (clears up old image, starts new compute tasks).
   /*! When the one_of_many parameter is true, it implies many other images are also being updated
     (affects fragmentation strategy for multithreading).
    */
   void image_function(const boost::shared_ptr<const MutatableImage>& image_fn,bool one_of_many);
 
+  //! As image_function, but if probing is enabled only a small probe image is rendered at first.
+  /*! If the probe scores below the mutation parameters' probe threshold, the image is replaced
+    (by mutating parent again, or with a new random image if parent is null) without recording history, and probed again.
+    Full rendering starts once an image is accepted.
+   */
+  void image_function_probed(const boost::shared_ptr<const MutatableImage>& image_fn,const boost::shared_ptr<const MutatableImage>& parent,bool one_of_many);
+
   //! Evolvotron main calls this with completed (but possibly aborted) tasks.
   void deliver(const boost::shared_ptr<const MutatableImageComputerTask>& task);
 
   //! Set the lock state.
   void lock(bool l,bool record_in_history);
 
+  //! Show the image normally, or as a heatmap of what its pixels cost to compute (rendering it again).
+  void heatmap(MutatableImage::Heatmap h);
+
  protected:
 
   //! Which farm this display should use.
   MutatableImageComputerFarm& farm() const;
 
-  //! Usual handler for repaint events.
+  //! Abort all our outstanding compute tasks, wherever they are.
+  void abort_tasks();
+
+  //! Common code for image_function and image_function_probed.
+  /*! If render is false the caller queues the render tasks itself.
+   */
+  void load(const boost::shared_ptr<const MutatableImage>& image_fn,bool one_of_many,bool render=true);
+
+  //! Queue tasks to render the current image at all resolution levels.
+  /*! Levels coarser than coarsest_level are skipped, as are full resolution multisample grids no finer than multisample_done.
+    Images estimated to be cheap enough skip the coarse levels anyway.
+   */
+  void push_render_tasks(bool one_of_many,int coarsest_level=12,uint multisample_done=0);
+
+  //! Task priority for computing some samples of the current image: the number of samples, weighted by their estimated cost.
+  uint cost_priority(real samples) const;
+
+  //! Apply the accumulated mid-button adjustments, reusing what's already been computed where possible.
+  void adjust();
+
+  //! Load a panned image, shifting the pixels already computed so only the newly exposed strips need computing.
+  /*! Returns false (and does nothing) if the current pixels aren't suitable.
+   */
+  bool adjust_pan(const boost::shared_ptr<const MutatableImage>& image_fn,const QPoint& pan);
+
+  //! Show the current image magnified about its centre and moved, as a placeholder until the adjusted image is rendered.
+  void adjust_placeholder(real zoom,const QPoint& pan);
+
+  //! Update _memory from the images held.
+  void charge_memory();
+
+  //! Area of _tiled_buffer covered by a tile.
+  const QRect tile_rect(uint tile) const;
+
+  //! Add tasks for all the tiles of _tiled_buffer not yet done, prioritised by distance from the centre of the visible area.
+  void push_tile_tasks(std::vector<boost::shared_ptr<MutatableImageComputerTask> >& tasks);
+
+  //! Deal with a completed probe task: either start rendering properly, or replace the image.
+  void probe_delivered(const boost::shared_ptr<const MutatableImageComputerTask>& task);
+
+  //! Usual handler for repaint events (which also recomputes released images).
   virtual void paintEvent(QPaintEvent* event);
 
   //! Usual handler for resize events.
   virtual void resizeEvent(QResizeEvent* event);
 
+  //! Handler for move events (which is what scrolling in a QScrollArea is).
+  virtual void moveEvent(QMoveEvent* event);
+
   //! Handler for mouse events.
   virtual void mousePressEvent(QMouseEvent* event);
 
@@ -205,6 +328,11 @@ class MutatableImageDisplay : public QWidget
 
   public slots:
 
+  //! If the display can't be seen at the moment, release its images to save memory; they're recomputed when it's next painted.
+  /*! Returns whether anything was released.
+   */
+  bool release_images();
+
   //! Simplify the held image, return the number of nodes eliminated
   uint simplify_constants(bool single);
 
@@ -216,6 +344,12 @@ class MutatableImageDisplay : public QWidget
   //! Called by timer
   void frame_advance();
 
+  //! Called by timer (after scrolling has paused) to queue outstanding tiles again in an order to suit the new view.
+  void retile();
+
+  //! Called by timer (after resizing has paused) to render at the new size.
+  void resized();
+
   //! Called from context menu.
   void menupick_respawn();
 
@@ -252,6 +386,15 @@ class MutatableImageDisplay : public QWidget
   //! Called from context menu.
   void menupick_lock();
 
+  //! Called from "Heatmap" submenu of context menu.
+  void menupick_heatmap_off();
+
+  //! Called from "Heatmap" submenu of context menu.
+  void menupick_heatmap_evaluations();
+
+  //! Called from "Heatmap" submenu of context menu.
+  void menupick_heatmap_time();
+
   //! Trivial wrapper for simplify_constants
   void menupick_simplify();
 
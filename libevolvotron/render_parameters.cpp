@@ -29,6 +29,8 @@ RenderParameters::RenderParameters(bool j,uint m,QObject* parent)
   :QObject(parent)
   ,_jittered_samples(j)
   ,_multisample_grid(clamped(m,1u,4u))
+  ,_enlargement_share(25)
+  ,_task_budget(0)
 {}
 
 RenderParameters::~RenderParameters()
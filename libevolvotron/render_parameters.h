@@ -66,9 +66,42 @@ class RenderParameters : public QObject
       if (change(_multisample_grid,v)) report_change();
     }
 
+  //! Accessor.
+  uint enlargement_share() const
+    {
+      return _enlargement_share;
+    }
+
+  //! Accessor.
+  /*! Doesn't affect what's rendered, so signals farm_settings_changed rather than changed.
+   */
+  void enlargement_share(uint v)
+    {
+      if (change(_enlargement_share,clamped(v,1u,99u))) emit farm_settings_changed();
+    }
+
+  //! Accessor.
+  uint task_budget() const
+    {
+      return _task_budget;
+    }
+
+  //! Accessor.
+  /*! Tasks overrunning the budget are downgraded (rendered coarser, without multisampling and with capped iterations),
+    but that's up to the compute farm as tasks run, so this signals farm_settings_changed rather than changed:
+    images already rendered aren't re-rendered.
+   */
+  void task_budget(uint v)
+    {
+      if (change(_task_budget,v)) emit farm_settings_changed();
+    }
+
 signals:
   void changed();
 
+  //! Emitted when only settings applied by the compute farm (thread shares, task budget) have changed; nothing needs re-rendering.
+  void farm_settings_changed();
+
  protected:
   void report_change();
 
@@ -81,6 +114,14 @@ signals:
   /*! Default is 1.  4 would be 16 samples in a 4x4 grid.
    */
   uint _multisample_grid;
+
+  //! Percentage of the compute threads enlargements are entitled to when the grid is busy too.
+  /*! The grid gets the rest.  Either can use all the threads when the other has nothing to do.
+   */
+  uint _enlargement_share;
+
+  //! Compute time (microseconds) allowed per sample of a task before it's downgraded (0 for no limit).
+  uint _task_budget;
 };
 
 
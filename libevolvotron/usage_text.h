@@ -176,16 +176,22 @@
 "</p>\n"
 "<p>\n"
 "  <ul><li>-E, --enlargement-threadpool <br>\n"
-"  Use a separate thread pool for computing enlargements. \n"
-"  Using this option ensures computation of enlargements \n"
-"  continue to make some progress even while the main grid \n"
-"  is being actively worked on. However, this will be at \n"
-"  the expense of main grid rendering performance. \n"
-"  Without this option, enlargements' final high-resolution \n"
-"  renderings are invariably lower priority than computation \n"
-"  for images in the main grid. \n"
-"  See also the -N option to control the priority of threads \n"
-"  in this pool. \n"
+"  Obsolete and ignored. Enlargements and the main grid now \n"
+"  share the compute threads, with the enlargements' share set \n"
+"  on the render parameters dialog (see Settings menu). \n"
+"</li>\n"
+"</ul>\n"
+"</p>\n"
+"<p>\n"
+"  <ul><li>--memory-cap <i>MB</i> <br>\n"
+"  A soft limit on the memory held for images, compute tasks and \n"
+"  function trees (see &quot;Compute statistics&quot;). Nothing is refused when \n"
+"  it's exceeded, but the images of displays which can't currently be \n"
+"  seen (minimised or scrolled out of view) are released, to be \n"
+"  recomputed when next shown, and then the oldest undo steps are \n"
+"  discarded, until usage is back under the limit. The last few undo \n"
+"  steps are always kept; if the limit still can't be met, a warning \n"
+"  is printed. The default of 0 means no limit. \n"
 "</li>\n"
 "</ul>\n"
 "</p>\n"
@@ -203,9 +209,26 @@
 "</p>\n"
 "<p>\n"
 "  <ul><li>-N, --Nice <i>enlargement niceness</i> <br>\n"
-"  Sets additional niceness (relative to the main application thread) \n"
-"  of the compute thread(s) computing enlargements (default value is 8). \n"
-"  Only effective in conjunction with -E option. \n"
+"  Obsolete and ignored (see -E). \n"
+"</li>\n"
+"</ul>\n"
+"</p>\n"
+"<p>\n"
+"  <ul><li>--profile <br>\n"
+"  Count evaluations of, and time spent in, each function node. \n"
+"  The results for an image (per function type, and per node) are \n"
+"  shown on the &quot;Profile&quot; tab of its &quot;Properties&quot; dialog. \n"
+"  Rendering is somewhat slower with this on. \n"
+"</li>\n"
+"</ul>\n"
+"</p>\n"
+"<p>\n"
+"  <ul><li>--stats <i>file</i> <br>\n"
+"  Writes the compute statistics (see the Settings menu's &quot;Compute \n"
+"  statistics&quot;) to the file every second, as one JSON object per line: \n"
+"  per-thread busy fraction and samples per second, totals of tasks \n"
+"  completed, aborted, deferred and downgraded, queued tasks by size \n"
+"  band, mean time to first pixels, and lock contention. \n"
 "</li>\n"
 "</ul>\n"
 "</p>\n"
@@ -221,6 +244,16 @@
 "</ul>\n"
 "</p>\n"
 "<p>\n"
+"  <ul><li>--trace <i>file</i> <br>\n"
+"  Records when each compute task is queued, taken by a compute thread, \n"
+"  started, deferred, aborted, completed and delivered to its display, \n"
+"  and writes the timeline to the file on exit, in Chrome's trace-event \n"
+"  JSON format (open it with chrome://tracing or ui.perfetto.dev). \n"
+"  Each compute thread's work shows as a span per task. \n"
+"</li>\n"
+"</ul>\n"
+"</p>\n"
+"<p>\n"
 "  <ul><li>-u, --unwrapped <br>\n"
 "  Modifies -F behaviour so that the specified &quot;favourite&quot; function \n"
 "  is NOT wrapped by space/colour transforms. NB For functions without leaf nodes \n"
@@ -347,6 +380,16 @@
 "</ul>\n"
 "</p>\n"
 "<p>\n"
+"  <ul><li>&quot;Heatmap&quot; shows, instead of the image's colours, what each pixel \n"
+"  costs to compute: the number of function nodes evaluated, or the \n"
+"  time taken. The colour scale is logarithmic and fixed, from black \n"
+"  (cheapest) through blue, red and yellow to white (most expensive), \n"
+"  so it picks out the regions and branches of a function which are \n"
+"  worth optimising or culling. &quot;Off&quot; returns to the normal image. \n"
+"</li>\n"
+"</ul>\n"
+"</p>\n"
+"<p>\n"
 "  <ul><li>&quot;Properties&quot; brings up a dialog box containing some information \n"
 "  about the image (e.g the number of function nodes it contains). \n"
 "</li>\n"
@@ -502,6 +545,22 @@
 "  function type to always be used as the root node of any new functions. \n"
 "  The function can be wrapped by some other random stuff, or unwrapped. \n"
 "  See also the -X and -x command line options. \n"
+"  &quot;Render parameters&quot; controls jitter and multisampling, the \n"
+"  share of the compute threads given to enlargements, and a task \n"
+"  budget (in microseconds per sample; off by default). A task \n"
+"  taking longer than its budget is finished more coarsely, without \n"
+"  multisampling and with its function's iterations capped, so \n"
+"  pathologically slow images don't tie up threads wanted for new \n"
+"  ones. Images rendered so are marked with a small yellow square \n"
+"  in their top right corner (a multisampled rendering cut short is \n"
+"  simply dropped, leaving the single sample one). \n"
+"  &quot;Compute statistics&quot; shows, updated every second, how busy each \n"
+"  compute thread is, samples computed per second, tasks completed, \n"
+"  aborted, deferred and downgraded (for overrunning the task budget), \n"
+"  how many tasks are queued (by size), the time from loading an \n"
+"  image to its first pixels appearing, and contention \n"
+"  for the task queues' lock, and the memory held for images, compute \n"
+"  tasks and function trees. \n"
 "  </li><li>Help menu: \n"
 "  Items to bring up documentation, and the usual &quot;About&quot; box \n"
 "  (which includes the license). \n"
@@ -549,8 +608,9 @@
 "  high-resolution rendering pass (especially with multisampling \n"
 "  enabled). Most convenient practice seems to be to go away and \n"
 "  leave them to complete, then come back and save them later. \n"
-"  Continuing to click away on the main grid effectively starves \n"
-"  them of CPU, unless the -E command-line option is used. \n"
+"  Enlargements get a share of the compute threads (25% by \n"
+"  default; see the render parameters dialog) while the main grid \n"
+"  is busy, and all of them when it isn't. \n"
 "</li>\n"
 "</ul>\n"
 "</p>\n"
@@ -655,6 +715,30 @@
 "  images will differ very little from their parents (hence the need for &quot;reheat&quot;). \n"
 "</p>\n"
 "<p>\n"
+"  The &quot;Probe&quot; tab of the mutation parameters dialog can be used to \n"
+"  weed out boring images automatically. When the probe threshold is \n"
+"  set (it is &quot;Off&quot; by default), each newly spawned or reset image is \n"
+"  first rendered at a tiny 16x16 resolution and scored (from 0 to 100) \n"
+"  on its colour variation and edge content, and on how well neighbouring \n"
+"  pixels correlate (so images which are just noise score poorly). Images \n"
+"  scoring below the threshold are replaced by another mutant (or new \n"
+"  random image) before any time is spent rendering them properly. The \n"
+"  number of images rejected this way is reported in the status bar. \n"
+"  Recoloured and warped spawns aren't probed: they keep the structure of \n"
+"  the image they were spawned from, which was already chosen. \n"
+"</p>\n"
+"<p>\n"
+"  The &quot;Cost&quot; tab of the mutation parameters dialog helps keep long sessions \n"
+"  interactive, as trees which grow over many generations (particularly with \n"
+"  nested iterative or filtering functions) can become very slow to render. \n"
+"  A &quot;Cost budget&quot; (in microseconds per sample, estimated from the function \n"
+"  tree; &quot;Off&quot; by default) rejects mutants estimated to be more expensive, \n"
+"  trying again a few times and then, if need be, cutting the iteration counts \n"
+"  of the cheapest. &quot;Parsimony&quot; is the probability of making two mutants and \n"
+"  keeping the one estimated to be cheaper; when it's on, parts of mutants \n"
+"  which are constant are also simplified. \n"
+"</p>\n"
+"<p>\n"
 "  There is also a dialog accessible from &quot;Functions...&quot; on the &quot;Settings&quot; menu. \n"
 "  This allows control over the relative proportions in which functions occur. \n"
 "  There is a tab showing the relative weighting of all functions (log-2 scale: each \n"
@@ -49,10 +49,10 @@ struct ClampZ
 };
 
 //! Function evaluation via symmetry.
-template <class SYMMETRY,class ZPOLICY> 
+template <class FUNCTION,class SYMMETRY,class ZPOLICY> 
   inline const XYZ FriezegroupEvaluate
     (
-     const Function& f,const XYZ& p,const SYMMETRY& sym,const ZPOLICY& zpol
+     const FUNCTION& f,const XYZ& p,const SYMMETRY& sym,const ZPOLICY& zpol
      )
 {
   return f(XYZ(sym(p.xy()),zpol(p.z())));
@@ -61,10 +61,10 @@ template <class SYMMETRY,class ZPOLICY>
 //! Function evaluation with blending.
 /*! NB Is symmetry unaware; blend must have already reduced points to base domain.
  */
-template<class BLEND,class ZPOLICY> 
+template<class FUNCTION,class BLEND,class ZPOLICY> 
   inline const XYZ FriezegroupBlend
     (
-     const Function& f0,const Function& f1,const XYZ& p,const BLEND& blend,const ZPOLICY& zpol
+     const FUNCTION& f0,const FUNCTION& f1,const XYZ& p,const BLEND& blend,const ZPOLICY& zpol
      )
 {
   const boost::tuple<real,XY,XY> b(blend(p.xy()));
@@ -73,10 +73,10 @@ template<class BLEND,class ZPOLICY>
     +(1.0-b.get<0>())*f1(XYZ(b.get<2>(),zpol(p.z())));
 }
 
-template<class BLEND,class ZPOLICY> 
+template<class FUNCTION,class BLEND,class ZPOLICY> 
   inline const XYZ FriezegroupBlend
     (
-     const Function& f,const XYZ& p,const BLEND& blend,const ZPOLICY& zpol
+     const FUNCTION& f,const XYZ& p,const BLEND& blend,const ZPOLICY& zpol
      )
 {
   return FriezegroupBlend(f,f,p,blend,zpol);
@@ -44,10 +44,6 @@ template <typename FUNCTION,uint PARAMETERS,uint ARGUMENTS,bool ITERATIVE,uint C
   //! Destructor.
   virtual ~FunctionBoilerplate();
 
-  //! Accessor providing function name
-  virtual const char* thisname() const
-    =0;
-
   //! Registration member returns a reference to class meta-information.
   static const FunctionRegistration get_registration(const char* fn_name);
     
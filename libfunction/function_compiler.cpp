@@ -0,0 +1,418 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+
+/*! \file
+  \brief Implementation of classes FunctionCompiler and FunctionCompiled.
+*/
+
+#include "libfunction_precompiled.h"
+
+#include "function_compiler.h"
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_BSD)
+#include <cerrno>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+// Set by libfunction.pro to the directory this library was built from.
+#ifndef EVOLVOTRON_COMPILER_INCLUDE
+#define EVOLVOTRON_COMPILER_INCLUDE .
+#endif
+#define function_compiler_stringify(S) function_compiler_stringify_expanded(S)
+#define function_compiler_stringify_expanded(S) #S
+
+namespace
+{
+  //! Non-function sources whose code evaluate bodies call into; built into every kernel.
+  const char*const support_sources[]=
+    {
+      "friezegroup.cpp",
+      "hex.cpp",
+      "margin.cpp",
+      "noise.cpp",
+      "random.cpp",
+      "transform.cpp",
+      "xy.cpp",
+      "xyz.cpp"
+    };
+
+  //! Collect the nodes of a tree in pre-order.
+  void collect(const FunctionNode& fn,std::vector<const FunctionNode*>& nodes)
+  {
+    nodes.push_back(&fn);
+    for (uint i=0;i<fn.args().size();i++)
+      collect(fn.arg(i),nodes);
+  }
+
+  //! 64-bit FNV-1a; only used to name cache entries.
+  const std::string hash(const std::string& s)
+  {
+    unsigned long long h=14695981039346656037ULL;
+    for (std::string::const_iterator it=s.begin();it!=s.end();it++)
+      {
+	h^=static_cast<unsigned char>(*it);
+	h*=1099511628211ULL;
+      }
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << h;
+    return out.str();
+  }
+
+  //! Whether a path can be passed to the shell simply by wrapping it in single quotes.
+  bool quotable(const std::string& s)
+  {
+    return (s.find('\'')==std::string::npos);
+  }
+
+  //! Read a whole (small) file, for echoing compiler output to the log.
+  const std::string slurp(const std::string& filename)
+  {
+    std::ifstream in(filename.c_str());
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+  }
+
+  const std::string default_cache_dir()
+  {
+    const char*const xdg=getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) return std::string(xdg)+"/evolvotron";
+    const char*const home=getenv("HOME");
+    if (home && home[0]) return std::string(home)+"/.cache/evolvotron";
+    return "";
+  }
+
+  const std::string default_cxx()
+  {
+    const char*const cxx=getenv("CXX");
+    return ((cxx && cxx[0]) ? std::string(cxx) : std::string("c++"));
+  }
+}
+
+FunctionCompiled::FunctionCompiled(void* handle,Kernel kernel)
+  :_handle(handle)
+  ,_kernel(kernel)
+{}
+
+FunctionCompiled::~FunctionCompiled()
+{
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_BSD)
+  dlclose(_handle);
+#endif
+}
+
+FunctionCompiler::FunctionCompiler(std::ostream& log,const std::string& include_dir,const std::string& cache_dir)
+  :_log(log)
+  ,_include_dir(include_dir.empty() ? std::string(function_compiler_stringify(EVOLVOTRON_COMPILER_INCLUDE)) : include_dir)
+  ,_cache_dir(cache_dir.empty() ? default_cache_dir() : cache_dir)
+  ,_cxx(default_cxx())
+{}
+
+FunctionCompiler::~FunctionCompiler()
+{}
+
+const std::string FunctionCompiler::source(const FunctionNode& fn)
+{
+  std::vector<const FunctionNode*> nodes;
+  collect(fn,nodes);
+  std::map<const FunctionNode*,uint> id;
+  for (uint n=0;n<nodes.size();n++)
+    id[nodes[n]]=n;
+
+  std::ostringstream out;
+  out << std::setprecision(17);
+  out << "// Generated by evolvotron's FunctionCompiler; edits will be lost.\n";
+  out << "#include \"function_compiler_prelude.h\"\n\n";
+
+  // Everything specific to this tree gets internal linkage: otherwise function statics in identically named
+  // node types would be unified (as GNU unique symbols) with those of any kernel loaded earlier.
+  out << "namespace\n{\n";
+
+  for (uint n=0;n<nodes.size();n++)
+    {
+      out
+	<< "struct Node" << n << "\n"
+	<< "{\n"
+	<< "  enum {arity=" << nodes[n]->args().size() << ",iterations=" << nodes[n]->iterations() << "};\n"
+	<< "  static real param(uint n);\n"
+	<< "  static const std::vector<real>& params();\n"
+	<< "  static const XYZ evaluate_arg(uint n,const XYZ& p);\n"
+	<< "  static bool arg_is_constant(uint n);\n"
+	<< "};\n\n";
+    }
+
+  for (uint n=0;n<nodes.size();n++)
+    {
+      const FunctionNode& node=*nodes[n];
+      const std::vector<real>& params=node.params();
+      if (params.empty())
+	{
+	  out
+	    << "inline real Node" << n << "::param(uint) {return 0.0;}\n"
+	    << "inline const std::vector<real>& Node" << n << "::params() {static const std::vector<real> v;return v;}\n";
+	}
+      else
+	{
+	  out << "static const real node" << n << "_params[" << params.size() << "]={";
+	  for (uint i=0;i<params.size();i++)
+	    out << (i ? "," : "") << params[i];
+	  out
+	    << "};\n"
+	    << "inline real Node" << n << "::param(uint n) {return node" << n << "_params[n];}\n"
+	    << "inline const std::vector<real>& Node" << n << "::params() {static const std::vector<real> v(node" << n << "_params,node" << n << "_params+" << params.size() << ");return v;}\n";
+	}
+
+      if (node.args().empty())
+	{
+	  out
+	    << "inline const XYZ Node" << n << "::evaluate_arg(uint,const XYZ&) {return XYZ(0.0,0.0,0.0);}\n"
+	    << "inline bool Node" << n << "::arg_is_constant(uint) {return false;}\n\n";
+	}
+      else
+	{
+	  out
+	    << "inline const XYZ Node" << n << "::evaluate_arg(uint n,const XYZ& p)\n"
+	    << "{\n"
+	    << "  switch (n)\n"
+	    << "    {\n";
+	  for (uint i=0;i<node.args().size();i++)
+	    {
+	      const FunctionNode& arg=node.arg(i);
+	      out << "    case " << i << ": return compiled::" << arg.thisname() << "<Node" << id[&arg] << ">().evaluate(p);\n";
+	    }
+	  out
+	    << "    }\n"
+	    << "  return XYZ(0.0,0.0,0.0);\n"
+	    << "}\n"
+	    << "inline bool Node" << n << "::arg_is_constant(uint n) {static const bool c[" << node.args().size() << "]={";
+	  for (uint i=0;i<node.args().size();i++)
+	    out << (i ? "," : "") << (node.arg(i).is_constant() ? "true" : "false");
+	  out << "};return c[n];}\n\n";
+	}
+    }
+
+  out << "}\n\n";
+
+  out
+    << "extern \"C\" void evolvotron_kernel(const real* p,real* v)\n"
+    << "{\n"
+    << "  const XYZ r(compiled::" << fn.thisname() << "<Node0>().evaluate(XYZ(p[0],p[1],p[2])));\n"
+    << "  v[0]=r.x();\n"
+    << "  v[1]=r.y();\n"
+    << "  v[2]=r.z();\n"
+    << "}\n";
+
+  return out.str();
+}
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_BSD)
+
+namespace
+{
+  //! Create a directory and any missing parents.
+  bool make_directories(const std::string& path)
+  {
+    for (std::string::size_type i=1;i<=path.size();i++)
+      {
+	if (i==path.size() || path[i]=='/')
+	  {
+	    const std::string dir(path,0,i);
+	    if (mkdir(dir.c_str(),0755)!=0 && errno!=EEXIST) return false;
+	  }
+      }
+    return true;
+  }
+
+  //! Names of all the headers in a directory, in a consistent order.
+  const std::set<std::string> list_headers(const std::string& dir)
+  {
+    std::set<std::string> names;
+    if (DIR*const d=opendir(dir.c_str()))
+      {
+	while (const struct dirent*const e=readdir(d))
+	  {
+	    const std::string name(e->d_name);
+	    if (name.size()>2 && name.compare(name.size()-2,2,".h")==0)
+	      names.insert(name);
+	  }
+	closedir(d);
+      }
+    return names;
+  }
+
+  bool exists(const std::string& filename)
+  {
+    struct stat s;
+    return (stat(filename.c_str(),&s)==0);
+  }
+}
+
+const std::string FunctionCompiler::options() const
+{
+  return "-O2 -ffp-contract=off -fPIC -shared -w -include libfunction_precompiled.h";
+}
+
+bool FunctionCompiler::build(const std::string& so,const std::string& inputs) const
+{
+  // Build to a private name and rename into place, so concurrent evolvotrons never load a half-written object.
+  std::ostringstream tmp;
+  tmp << so << "." << getpid();
+  const std::string log(so.substr(0,so.size()-3)+".log");
+
+  std::ostringstream cmd;
+  cmd << _cxx << " " << options() << " -I'" << _include_dir << "' -o '" << tmp.str() << "'" << inputs << " >'" << log << "' 2>&1";
+
+  _log << "Compiler: building " << so << "\n";
+  if (std::system(cmd.str().c_str())!=0 || rename(tmp.str().c_str(),so.c_str())!=0)
+    {
+      _log << "Compiler: build failed:\n" << cmd.str() << "\n" << slurp(log);
+      unlink(tmp.str().c_str());
+      return false;
+    }
+  return true;
+}
+
+boost::shared_ptr<const FunctionCompiled> FunctionCompiler::compile(const FunctionNode& fn) const
+{
+  boost::shared_ptr<const FunctionCompiled> none;
+
+  if (_cache_dir.empty())
+    {
+      _log << "Compiler: no cache directory (neither XDG_CACHE_HOME nor HOME set)\n";
+      return none;
+    }
+  if (!exists(_include_dir+"/function_compiler_prelude.h"))
+    {
+      _log << "Compiler: no function_compiler_prelude.h in " << _include_dir << "\n";
+      return none;
+    }
+
+  if (!quotable(_include_dir) || !quotable(_cache_dir))
+    {
+      _log << "Compiler: can't quote directory names for the shell\n";
+      return none;
+    }
+  if (!make_directories(_cache_dir))
+    {
+      _log << "Compiler: can't create " << _cache_dir << "\n";
+      return none;
+    }
+
+  // The non-function code is the same for every kernel and takes far longer to build than any one kernel,
+  // so it goes in a shared object of its own which kernels are linked against.
+  // Its name hashes every header too, so kernels are rebuilt whenever any of the code they inline changes.
+  std::string support_key(_cxx+"\n"+options()+"\n"+_include_dir+"\n");
+  std::ostringstream support_inputs;
+  for (uint i=0;i<sizeof(support_sources)/sizeof(support_sources[0]);i++)
+    {
+      const std::string filename(_include_dir+"/"+support_sources[i]);
+      support_key+=slurp(filename);
+      support_inputs << " '" << filename << "'";
+    }
+  const std::set<std::string> headers(list_headers(_include_dir));
+  for (std::set<std::string>::const_iterator it=headers.begin();it!=headers.end();it++)
+    support_key+=*it+"\n"+slurp(_include_dir+"/"+*it);
+  const std::string support(_cache_dir+"/support_"+hash(support_key)+".so");
+  if (!exists(support) && !build(support,support_inputs.str()))
+    return none;
+
+  const std::string src(source(fn));
+  const std::string stem(_cache_dir+"/kernel_"+hash(support+"\n"+src));
+  const std::string so(stem+".so");
+
+  if (exists(so))
+    {
+      _log << "Compiler: using cached " << so << "\n";
+    }
+  else
+    {
+      {
+	std::ofstream out((stem+".cpp").c_str());
+	out << src;
+	if (!out)
+	  {
+	    _log << "Compiler: can't write " << stem << ".cpp\n";
+	    return none;
+	  }
+      }
+      if (!build(so," '"+stem+".cpp' '"+support+"'"))
+	return none;
+    }
+
+  void*const handle=dlopen(so.c_str(),RTLD_NOW|RTLD_LOCAL);
+  if (!handle)
+    {
+      _log << "Compiler: can't load " << so << ": " << dlerror() << "\n";
+      return none;
+    }
+  const FunctionCompiled::Kernel kernel=reinterpret_cast<FunctionCompiled::Kernel>(dlsym(handle,"evolvotron_kernel"));
+  if (!kernel)
+    {
+      _log << "Compiler: no kernel entry point in " << so << "\n";
+      dlclose(handle);
+      return none;
+    }
+  boost::shared_ptr<const FunctionCompiled> compiled(new FunctionCompiled(handle,kernel));
+
+  const real d=discrepancy(fn,*compiled);
+  if (!(d<=1e-6))
+    {
+      _log << "Compiler: " << so << " disagrees with the interpreter (by " << d << "); not using it\n";
+      return none;
+    }
+
+  return compiled;
+}
+
+#else
+
+boost::shared_ptr<const FunctionCompiled> FunctionCompiler::compile(const FunctionNode&) const
+{
+  _log << "Compiler: not supported on this platform\n";
+  return boost::shared_ptr<const FunctionCompiled>();
+}
+
+#endif
+
+real FunctionCompiler::discrepancy(const FunctionNode& fn,const FunctionCompiled& compiled,uint grid)
+{
+  real worst=0.0;
+  for (uint j=0;j<grid;j++)
+    for (uint i=0;i<grid;i++)
+      {
+	const XYZ p(-1.0+2.0*(i+0.5)/grid,-1.0+2.0*(j+0.5)/grid,0.0);
+	const XYZ a(fn(p));
+	const XYZ b(compiled(p));
+	for (uint c=0;c<3;c++)
+	  {
+	    const real va=(c==0 ? a.x() : (c==1 ? a.y() : a.z()));
+	    const real vb=(c==0 ? b.x() : (c==1 ? b.y() : b.z()));
+	    if (va==vb || (va!=va && vb!=vb)) continue;  // Identical, or both NaN
+	    const real d=fabs(va-vb);
+	    if (d!=d) return d;  // NaN against a number: callers treat NaN as failure
+	    if (d>worst) worst=d;
+	  }
+      }
+  return worst;
+}
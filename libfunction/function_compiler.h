@@ -0,0 +1,130 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+
+/*! \file
+  \brief Interfaces for classes FunctionCompiler and FunctionCompiled.
+*/
+
+#ifndef _function_compiler_h_
+#define _function_compiler_h_
+
+class FunctionNode;
+
+//! A function tree compiled to native code and loaded from a shared object.
+/*! Evaluates exactly as the tree it was compiled from did (FunctionCompiler::compile checks that),
+  but without any of the interpreter's virtual calls, parameter vector lookups or child node indirection.
+ */
+class FunctionCompiled : boost::noncopyable
+{
+ public:
+  //! Signature of the entry point exported by a kernel: writes f(p[0],p[1],p[2]) to v[0..2].
+  typedef void (*Kernel)(const real* p,real* v);
+
+  //! Constructor takes ownership of a dlopen handle.
+  FunctionCompiled(void* handle,Kernel kernel);
+
+  //! Destructor unloads the shared object.
+  ~FunctionCompiled();
+
+  //! Evaluate the compiled function.
+  const XYZ operator()(const XYZ& p) const
+    {
+      const real a[3]={p.x(),p.y(),p.z()};
+      real v[3];
+      (*_kernel)(a,v);
+      return XYZ(v[0],v[1],v[2]);
+    }
+
+ private:
+  //! Handle of the loaded shared object.
+  void*const _handle;
+
+  //! Entry point.
+  const Kernel _kernel;
+};
+
+//! Translates function trees to C++, builds them with the system compiler and loads the result.
+/*! Each node of the tree becomes a generated type carrying its parameters and iteration count as constants,
+  and the ordinary function headers are re-expanded (by function_compiler_prelude.h) as templates over those types,
+  so the evaluate bodies are the interpreter's own but the compiler sees straight through the whole tree.
+  Built kernels are kept in a cache directory keyed by a hash of their source,
+  so the same tree is only ever compiled once.
+  Anything going wrong (no compiler, build failure, mismatch against the interpreter) is reported to the log
+  and compile() returns null, leaving the caller to carry on with the interpreter.
+ */
+class FunctionCompiler
+{
+ public:
+  //! Constructor.
+  /*! Empty include_dir or cache_dir select the defaults (the libfunction source directory this was built from,
+    and $XDG_CACHE_HOME/evolvotron or ~/.cache/evolvotron respectively).
+    The compiler run is $CXX if set, otherwise c++.
+   */
+  FunctionCompiler(std::ostream& log,const std::string& include_dir="",const std::string& cache_dir="");
+
+  //! Destructor.
+  ~FunctionCompiler();
+
+  //! Accessor.
+  const std::string& include_dir() const
+    {
+      return _include_dir;
+    }
+
+  //! Accessor.
+  const std::string& cache_dir() const
+    {
+      return _cache_dir;
+    }
+
+  //! The kernel source generated for a tree.
+  static const std::string source(const FunctionNode& fn);
+
+  //! Build (or fetch from the cache), load and verify a kernel for the tree.
+  /*! Returns null if that didn't work out for any reason.
+   */
+  boost::shared_ptr<const FunctionCompiled> compile(const FunctionNode& fn) const;
+
+  //! Compare compiled and interpreted evaluation on a grid of points spanning [-1,1]^2 at z=0.
+  /*! Returns the largest absolute difference found in any channel.
+   */
+  static real discrepancy(const FunctionNode& fn,const FunctionCompiled& compiled,uint grid=16);
+
+ private:
+  //! Compiler options used for everything built.
+  const std::string options() const;
+
+  //! Run the compiler to build a shared object from (already shell quoted) inputs.
+  bool build(const std::string& so,const std::string& inputs) const;
+
+  //! Where to write messages.
+  std::ostream& _log;
+
+  //! Directory containing function_compiler_prelude.h and the function headers.
+  const std::string _include_dir;
+
+  //! Directory for kernel sources and shared objects.
+  const std::string _cache_dir;
+
+  //! Compiler command.
+  const std::string _cxx;
+};
+
+#endif
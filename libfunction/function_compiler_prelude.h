@@ -0,0 +1,209 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+
+/*! \file
+  \brief Prelude for kernels generated by FunctionCompiler.
+  This is never included by evolvotron itself; it's the first thing in every generated kernel source.
+  It re-expands the ordinary function headers so each function class becomes a template
+  over a generated node type which supplies the node's parameters and arguments as compile time constants,
+  so the compiler can inline the whole tree's evaluate bodies into one kernel.
+*/
+
+#ifndef _function_compiler_prelude_h_
+#define _function_compiler_prelude_h_
+
+#include "libfunction_precompiled.h"
+
+#include "friezegroup.h"
+#include "hex.h"
+#include "mutation_parameters.h"
+#include "noise.h"
+#include "transform.h"
+
+//! Argument handle passed to evaluate bodies in place of a FunctionNode reference.
+template <typename N> class FunctionCompiledArg
+{
+ public:
+  FunctionCompiledArg(uint n)
+    :_n(n)
+    {}
+
+  const XYZ operator()(const XYZ& p) const
+    {
+      return N::evaluate_arg(_n,p);
+    }
+
+  const XYZ operator()(const real weight,const XYZ& p) const
+    {
+      return (weight==0.0 ? XYZ(0.0,0.0,0.0) : weight*N::evaluate_arg(_n,p));
+    }
+
+  bool is_constant() const
+    {
+      return N::arg_is_constant(_n);
+    }
+
+ private:
+  const uint _n;
+};
+
+//! Stands in for the argument vector; only its size is ever asked for by evaluate bodies.
+template <typename N> class FunctionCompiledArgs
+{
+ public:
+  uint size() const
+    {
+      return N::arity;
+    }
+};
+
+//! Replaces FunctionBoilerplate as the base of every function class in a kernel.
+template <typename N> class FunctionCompiledNode
+{
+ public:
+  real param(uint n) const
+    {
+      return N::param(n);
+    }
+
+  const std::vector<real>& params() const
+    {
+      return N::params();
+    }
+
+  uint iterations() const
+    {
+      return N::iterations;
+    }
+
+  const FunctionCompiledArg<N> arg(uint n) const
+    {
+      return FunctionCompiledArg<N>(n);
+    }
+
+  const FunctionCompiledArgs<N> args() const
+    {
+      return FunctionCompiledArgs<N>();
+    }
+
+ protected:
+  //@{
+  //! Same sampling steps as FunctionNode.
+  static real epsilon() {return 1e-6;}
+  static real epsilon2() {return 2.0*epsilon();}
+  static real inv_epsilon() {return 1.0/epsilon();}
+  static real inv_epsilon2() {return 1.0/epsilon2();}
+  static real big_epsilon() {return sqrt(epsilon());}
+  //@}
+};
+
+#undef FUNCTION_BEGIN
+#undef FUNCTION_END
+
+//! Each function class becomes a template over its generated node type.
+#define FUNCTION_BEGIN(FN,NP,NA,IT,CL) \
+   template <typename N> class FN : public FunctionCompiledNode<N> \
+   {public: \
+     typedef FunctionCompiledNode<N> Superclass; \
+     using Superclass::param; \
+     using Superclass::params; \
+     using Superclass::iterations; \
+     using Superclass::arg; \
+     using Superclass::args; \
+     using Superclass::epsilon; \
+     using Superclass::epsilon2; \
+     using Superclass::inv_epsilon; \
+     using Superclass::inv_epsilon2; \
+     using Superclass::big_epsilon;
+
+#define FUNCTION_END(FN) };
+
+// The templates live in their own namespace so they don't collide with the forward declarations in function_node.h.
+namespace compiled
+{
+using ::Transform;
+
+// Every header using FUNCTION_BEGIN needs listing here (as well as in register_all_functions).
+// Without virtual, only the evaluate bodies actually called by a kernel get instantiated;
+// the mutation and persistence members never compile against the stand-in base.
+#define virtual
+
+#include "function_compose_pair.h"
+#include "function_compose_triple.h"
+#include "function_constant.h"
+#include "function_identity.h"
+#include "function_post_transform.h"
+#include "function_pre_transform.h"
+#include "function_top.h"
+#include "function_transform.h"
+#include "function_transform_generalised.h"
+#include "functions_arithmetic.h"
+#include "functions_choose.h"
+#include "functions_filter.h"
+#include "functions_friezegroup_hop.h"
+#include "functions_friezegroup_jump.h"
+#include "functions_friezegroup_sidle.h"
+#include "functions_friezegroup_spinhop.h"
+#include "functions_friezegroup_spinjump.h"
+#include "functions_friezegroup_spinsidle.h"
+#include "functions_friezegroup_step.h"
+#include "functions_geometry.h"
+#include "functions_gradient.h"
+#include "functions_juliabrot.h"
+#include "functions_kaleidoscope.h"
+#include "functions_magnitude.h"
+#include "functions_misc.h"
+#include "functions_noise.h"
+#include "functions_quantize.h"
+#include "functions_render.h"
+#include "functions_shadow.h"
+#include "functions_spherical.h"
+#include "functions_spiral.h"
+#include "functions_tartan.h"
+#include "functions_transform.h"
+
+#undef virtual
+
+//! Mirrors FunctionTop::evaluate in function_top.cpp (the only evaluate not defined in its header).
+template <typename N> const XYZ FunctionTop<N>::evaluate(const XYZ& p) const
+{
+  const Transform space_transform(params(),0);
+  const XYZ sp(space_transform.transformed(p)); 
+  const XYZ v(arg(0)(sp));
+  const XYZ tv(tanh(0.5*v.x()),tanh(0.5*v.y()),tanh(0.5*v.z()));
+  const Transform colour_transform(params(),12);
+  return colour_transform.transformed(tv);
+}
+
+// Same seeds as functions_noise.cpp so compiled noise matches the interpreter's.
+template <typename N> Noise FunctionNoiseOneChannel<N>::_noise(100);
+
+template <typename N> Noise FunctionMultiscaleNoiseOneChannel<N>::_noise(101);
+
+template <typename N> Noise FunctionNoiseThreeChannel<N>::_noise0(200);
+template <typename N> Noise FunctionNoiseThreeChannel<N>::_noise1(300);
+template <typename N> Noise FunctionNoiseThreeChannel<N>::_noise2(400);
+
+template <typename N> Noise FunctionMultiscaleNoiseThreeChannel<N>::_noise0(201);
+template <typename N> Noise FunctionMultiscaleNoiseThreeChannel<N>::_noise1(202);
+template <typename N> Noise FunctionMultiscaleNoiseThreeChannel<N>::_noise2(203);
+}
+
+#endif
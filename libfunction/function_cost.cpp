@@ -0,0 +1,208 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+
+/*! \file
+  \brief Implementation of class FunctionCost.
+*/
+
+#include "libfunction_precompiled.h"
+
+#include "function_cost.h"
+
+#include "function_node_info.h"
+#include "function_registration.h"
+#include "function_registry.h"
+#include "mutation_parameters.h"
+
+namespace
+{
+  //! Seconds taken by a node of an unmeasured class (roughly a simple node's evaluation).
+  const real default_seconds=25e-9;
+
+  //! Measured function classes.
+  std::map<std::string,FunctionCost::Weights> measured;
+
+  //! What a node costs: mean evaluations (including its own) and seconds, per evaluation.
+  struct Measurement
+  {
+    Measurement()
+      :evaluations(0.0)
+      ,seconds(0.0)
+      {}
+
+    real evaluations;
+    real seconds;
+  };
+
+  //! Evaluate a node at each point, first counting evaluations and then timing (with counting off, so it doesn't add to the time).
+  Measurement measure(const FunctionNode& node,const std::vector<XYZ>& points)
+  {
+    const uint repetitions=4;
+    Measurement m;
+
+    FunctionProfile::count(true);
+    const unsigned long long evaluations=FunctionProfile::evaluations();
+    for (uint i=0;i<points.size();i++)
+      node(points[i]);
+    m.evaluations=static_cast<real>(FunctionProfile::evaluations()-evaluations)/points.size();
+    FunctionProfile::count(false);
+
+    const double start=FunctionProfile::now();
+    for (uint r=0;r<repetitions;r++)
+      for (uint i=0;i<points.size();i++)
+	node(points[i]);
+    m.seconds=(FunctionProfile::now()-start)/(repetitions*points.size());
+
+    return m;
+  }
+
+  //! Mean measurement of a few instances of a class with random parameters and identity arguments.
+  /*! Returns false if the class couldn't be instantiated.
+   */
+  bool measure(const FunctionRegistry& registry,const FunctionRegistration& registration,uint iterations,const MutationParameters& parameters,const std::vector<XYZ>& points,Measurement& m)
+  {
+    const uint instances=4;
+    m=Measurement();
+    for (uint n=0;n<instances;n++)
+      {
+	FunctionNodeInfo info;
+	info.type(registration.name());
+	FunctionNode::stubparams(info.params(),parameters,registration.params());
+	for (uint a=0;a<registration.args();a++)
+	  {
+	    info.args().push_back(new FunctionNodeInfo);
+	    info.args().back().type("FunctionIdentity");
+	  }
+	info.iterations(iterations);
+
+	std::string report;
+	const std::auto_ptr<FunctionNode> node(FunctionNode::create(registry,info,report));
+	if (!node.get())
+	  {
+	    std::clog << "Couldn't measure cost of " << registration.name() << ": " << report << "\n";
+	    return false;
+	  }
+
+	const Measurement instance=measure(*node,points);
+	m.evaluations+=instance.evaluations/instances;
+	m.seconds+=instance.seconds/instances;
+      }
+    return true;
+  }
+}
+
+void FunctionCost::calibrate()
+{
+  const double start=FunctionProfile::now();
+
+  // Mustn't add to the profile, or be slowed down by it.
+  const bool profiling=FunctionProfile::enabled();
+  const bool counting=FunctionProfile::counting();
+  FunctionProfile::enable(false);
+
+  const MutationParameters parameters(1,false,false);
+  const FunctionRegistry& registry=parameters.function_registry();
+
+  std::vector<XYZ> points;
+  for (uint i=0;i<256;i++)
+    points.push_back(XYZ(2.0*parameters.r01()-1.0,2.0*parameters.r01()-1.0,2.0*parameters.r01()-1.0));
+
+  // What an argument costs, to be taken off
+  Measurement identity;
+  const FunctionRegistration*const identity_registration=registry.lookup("FunctionIdentity");
+  if (identity_registration) measure(registry,*identity_registration,0,parameters,points,identity);
+
+  const FunctionRegistry::Registrations& registrations=registry.registrations();
+  for (FunctionRegistry::Registrations::const_iterator it=registrations.begin();it!=registrations.end();it++)
+    {
+      const FunctionRegistration& registration=*it->second;
+      const uint args=std::max(1u,registration.args());
+
+      // Cost at an iteration count, less the arguments
+      const uint n[2]={1,16};
+      real self[2];
+      real fanout[2];
+      bool ok=true;
+      for (uint i=0;i<(registration.iterative() ? 2 : 1) && ok;i++)
+	{
+	  Measurement m;
+	  ok=measure(registry,registration,(registration.iterative() ? n[i] : 0),parameters,points,m);
+	  self[i]=std::max(0.0,m.seconds-(m.evaluations-1.0)*identity.seconds);
+	  fanout[i]=(m.evaluations-1.0)/args;
+	}
+      if (!ok) continue;
+
+      Weights w;
+      if (registration.iterative())
+	{
+	  w.self_per_iteration=std::max(0.0,(self[1]-self[0])/(n[1]-n[0]));
+	  w.self=std::max(0.0,self[0]-n[0]*w.self_per_iteration);
+	  w.fanout_per_iteration=std::max(0.0,(fanout[1]-fanout[0])/(n[1]-n[0]));
+	  w.fanout=std::max(0.0,fanout[0]-n[0]*w.fanout_per_iteration);
+	}
+      else
+	{
+	  w.self=self[0];
+	  w.fanout=fanout[0];
+	}
+      measured[registration.name()]=w;
+    }
+
+  FunctionProfile::count(counting);
+  FunctionProfile::enable(profiling);
+
+  std::clog << "Calibrated cost of " << measured.size() << " function classes in " << FunctionProfile::now()-start << "s\n";
+}
+
+bool FunctionCost::calibrated()
+{
+  return !measured.empty();
+}
+
+const FunctionCost::Weights FunctionCost::weights(const std::string& class_name,bool iterative)
+{
+  const std::map<std::string,Weights>::const_iterator it=measured.find(class_name);
+  if (it!=measured.end()) return it->second;
+
+  Weights w;
+  if (iterative)
+    {
+      w.self_per_iteration=default_seconds;
+      w.fanout_per_iteration=1.0;
+    }
+  else
+    {
+      w.self=default_seconds;
+      w.fanout=1.0;
+    }
+  return w;
+}
+
+real FunctionCost::estimate(const FunctionNode& node)
+{
+  const Weights w=weights(node.thisname(),node.iterations()!=0);
+
+  real args=0.0;
+  for (uint i=0;i<node.args().size();i++)
+    args+=estimate(node.arg(i));
+
+  const real n=node.iterations();
+  return w.self+n*w.self_per_iteration+(w.fanout+n*w.fanout_per_iteration)*args;
+}
@@ -0,0 +1,78 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+
+/*! \file
+  \brief Interface for class FunctionCost.
+*/
+
+#ifndef _function_cost_h_
+#define _function_cost_h_
+
+class FunctionNode;
+
+//! Static estimate of what a function tree costs to evaluate.
+/*! A node costs its own work, plus each argument's cost times the number of times the node evaluates it
+  (its fan-out: e.g 7 for FunctionFilter3D's stencil, the iteration count for FunctionAverageSamples).
+  Both are modelled per function class as linear in the node's iteration count.
+  Until calibrate() is called every node is taken to be the same small amount of work with a fan-out of one
+  (per iteration, for iterative nodes).
+  Estimates are in seconds per evaluation of the root, i.e per sample.
+ */
+class FunctionCost
+{
+ public:
+
+  //! Model of a function class.
+  struct Weights
+  {
+    Weights()
+      :self(0.0)
+      ,self_per_iteration(0.0)
+      ,fanout(0.0)
+      ,fanout_per_iteration(0.0)
+      {}
+
+    //! Seconds a node takes itself (excluding its arguments), plus self_per_iteration per iteration.
+    real self;
+    real self_per_iteration;
+
+    //! Evaluations of each argument per evaluation of a node, plus fanout_per_iteration per iteration.
+    real fanout;
+    real fanout_per_iteration;
+  };
+
+  //! Measure every registered function class.
+  /*! Each class is instantiated with random parameters and identity arguments (at 1 and 16 iterations for iterative classes)
+    and evaluated at random points: fan-out by counting evaluations, own work by timing less the time taken by the arguments.
+    Takes a fraction of a second.  Estimates aren't safe while this is running, so call it before any other threads are estimating.
+   */
+  static void calibrate();
+
+  //! Whether calibrate has been called.
+  static bool calibrated();
+
+  //! The model used for a function class.
+  static const Weights weights(const std::string& class_name,bool iterative);
+
+  //! Estimated seconds to evaluate a node (and everything below it).
+  static real estimate(const FunctionNode& node);
+};
+
+#endif
@@ -36,19 +36,24 @@ class Function : boost::noncopyable
 {
  public:
 
+  //! Destructor.  The profiler keys results by address, so has to be told.
   virtual ~Function()
-    {}
+    {
+      if (FunctionProfile::enabled()) FunctionProfile::forget(*this);
+    }
 
   //! Convenience wrapper for evaluate (actually, evaluate is protected so can't be called externally anyway)
+  /*! All evaluations go through here, so this is where the (opt-in) profiler hooks in.
+   */
   const XYZ operator()(const XYZ& p) const
     {
-      return evaluate(p);
+      return (FunctionProfile::hooked() ? FunctionProfile::evaluate(*this,p) : evaluate(p));
     }
 
   //! Weighted evaluate; fastpath for zero weight.
   const XYZ operator()(const real weight,const XYZ& p) const
     {
-      return (weight==0.0 ? XYZ(0.0,0.0,0.0) : weight*evaluate(p));
+      return (weight==0.0 ? XYZ(0.0,0.0,0.0) : weight*(*this)(p));
     }
 
   //! This what distinguishes different types of function.
@@ -207,6 +212,10 @@ class FunctionNode : public Function
   virtual std::ostream& save_function(std::ostream& out,uint indent) const
     =0;
 
+  //! Accessor providing function name
+  virtual const char* thisname() const
+    =0;
+
  protected:
 
   //! Save the function tree.  Common code needing a function name.
@@ -0,0 +1,306 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class FunctionProfile.
+*/
+
+#include "libfunction_precompiled.h"
+
+#include "function_profile.h"
+
+#include "margin.h"
+
+#include <pthread.h>
+
+volatile bool FunctionProfile::_enabled=false;
+volatile bool FunctionProfile::_counting=false;
+volatile bool FunctionProfile::_hooked=false;
+
+namespace
+{
+  //! What's accumulated for each node.
+  struct Stats
+  {
+    Stats()
+      :evaluations(0)
+      ,sampled(0)
+      ,inclusive(0.0)
+      ,exclusive(0.0)
+      {}
+
+    unsigned long long evaluations;
+    unsigned long long sampled;
+    double inclusive;
+    double exclusive;
+  };
+
+  //! One thread's accumulated results, and its state part way through an evaluation.
+  struct ThreadData
+  {
+    ThreadData()
+      :depth(0)
+      ,top_evaluations(0)
+      ,sampling(false)
+      {
+	pthread_mutex_init(&mutex,0);
+      }
+
+    //! Held by the owning thread for the duration of each top level evaluation, and by reports.
+    pthread_mutex_t mutex;
+
+    std::map<const Function*,Stats> stats;
+
+    //! Nesting depth of the evaluation in progress.
+    uint depth;
+
+    //! Counts top level evaluations, to pick which are timed.
+    unsigned long long top_evaluations;
+
+    //! Whether the current top level evaluation is being timed.
+    bool sampling;
+
+    //! Time spent so far in the arguments of each node being (timed) evaluated.
+    std::vector<double> child_time;
+  };
+
+  //! Guards the list of all threads' data.
+  pthread_mutex_t threads_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+  //! Every thread's data.  Never freed: results outlive the threads which computed them.
+  std::vector<ThreadData*> threads;
+
+  //! This thread's data (null until it first evaluates anything with profiling on).
+  __thread ThreadData* this_thread=0;
+
+  //! Evaluations by this thread.
+  __thread unsigned long long this_thread_evaluations=0;
+
+  ThreadData& thread_data()
+  {
+    if (!this_thread)
+      {
+	this_thread=new ThreadData;
+	pthread_mutex_lock(&threads_mutex);
+	threads.push_back(this_thread);
+	pthread_mutex_unlock(&threads_mutex);
+      }
+    return *this_thread;
+  }
+
+  //! Per-node entries for a tree, depth first, with each node's address.
+  void collect(const FunctionNode& node,uint depth,std::vector<std::pair<const Function*,FunctionProfile::Entry> >& out)
+  {
+    FunctionProfile::Entry e;
+    e.name=node.thisname();
+    e.depth=depth;
+    out.push_back(std::make_pair(static_cast<const Function*>(&node),e));
+    for (uint i=0;i<node.args().size();i++)
+      collect(node.arg(i),depth+1,out);
+  }
+
+  bool more_exclusive(const FunctionProfile::Entry& a,const FunctionProfile::Entry& b)
+  {
+    return a.exclusive>b.exclusive;
+  }
+
+  std::ostream& write_table(std::ostream& out,const std::vector<FunctionProfile::Entry>& entries,bool indent)
+  {
+    double total=0.0;
+    for (uint i=0;i<entries.size();i++)
+      total+=entries[i].exclusive;
+
+    out
+      << std::setw(14) << "evaluations"
+      << std::setw(12) << "incl. ms"
+      << std::setw(12) << "excl. ms"
+      << std::setw(8) << "excl.%"
+      << "  function\n";
+    for (uint i=0;i<entries.size();i++)
+      {
+	const FunctionProfile::Entry& e=entries[i];
+	out
+	  << std::setw(14) << e.evaluations
+	  << std::fixed << std::setprecision(1)
+	  << std::setw(12) << 1000.0*e.inclusive
+	  << std::setw(12) << 1000.0*e.exclusive
+	  << std::setw(8) << (total>0.0 ? 100.0*e.exclusive/total : 0.0)
+	  << "  ";
+	if (indent) out << Margin(e.depth);
+	out << e.name << "\n";
+      }
+    return out;
+  }
+}
+
+double FunctionProfile::now()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+1e-9*t.tv_nsec;
+}
+
+unsigned long long FunctionProfile::evaluations()
+{
+  return this_thread_evaluations;
+}
+
+const XYZ FunctionProfile::evaluate(const Function& fn,const XYZ& p)
+{
+  this_thread_evaluations++;
+  if (!_enabled) return fn.evaluate(p);
+
+  ThreadData& t=thread_data();
+  if (t.depth==0)
+    {
+      pthread_mutex_lock(&t.mutex);
+      t.sampling=(t.top_evaluations++%sample_interval()==0);
+    }
+
+  // Map nodes don't move, so the reference stays good while arguments add entries.
+  Stats& s=t.stats[&fn];
+  s.evaluations++;
+  t.depth++;
+
+  XYZ ret;
+  if (t.sampling)
+    {
+      t.child_time.push_back(0.0);
+      const double start=now();
+      ret=fn.evaluate(p);
+      const double elapsed=now()-start;
+      const double children=t.child_time.back();
+      t.child_time.pop_back();
+
+      s.sampled++;
+      s.inclusive+=elapsed;
+      s.exclusive+=elapsed-children;
+      if (!t.child_time.empty()) t.child_time.back()+=elapsed;
+    }
+  else
+    {
+      ret=fn.evaluate(p);
+    }
+
+  t.depth--;
+  if (t.depth==0)
+    pthread_mutex_unlock(&t.mutex);
+
+  return ret;
+}
+
+void FunctionProfile::results(const FunctionNode& root,std::vector<Entry>& by_node,std::vector<Entry>& by_class)
+{
+  std::vector<std::pair<const Function*,Entry> > nodes;
+  collect(root,0,nodes);
+
+  // Sum over threads; timings are scaled up by the proportion of each node's evaluations that were timed.
+  std::vector<Stats> totals(nodes.size());
+  pthread_mutex_lock(&threads_mutex);
+  for (uint i=0;i<threads.size();i++)
+    {
+      pthread_mutex_lock(&threads[i]->mutex);
+      for (uint n=0;n<nodes.size();n++)
+	{
+	  const std::map<const Function*,Stats>::const_iterator it=threads[i]->stats.find(nodes[n].first);
+	  if (it!=threads[i]->stats.end())
+	    {
+	      totals[n].evaluations+=it->second.evaluations;
+	      totals[n].sampled+=it->second.sampled;
+	      totals[n].inclusive+=it->second.inclusive;
+	      totals[n].exclusive+=it->second.exclusive;
+	    }
+	}
+      pthread_mutex_unlock(&threads[i]->mutex);
+    }
+  pthread_mutex_unlock(&threads_mutex);
+
+  by_node.clear();
+  by_class.clear();
+  std::map<std::string,uint> class_index;
+  for (uint n=0;n<nodes.size();n++)
+    {
+      Entry e(nodes[n].second);
+      const Stats& s=totals[n];
+      const double scale=(s.sampled ? static_cast<double>(s.evaluations)/s.sampled : 0.0);
+      e.evaluations=s.evaluations;
+      e.inclusive=scale*s.inclusive;
+      e.exclusive=scale*s.exclusive;
+      by_node.push_back(e);
+
+      const std::map<std::string,uint>::const_iterator it=class_index.find(e.name);
+      if (it==class_index.end())
+	{
+	  class_index[e.name]=by_class.size();
+	  e.depth=0;
+	  by_class.push_back(e);
+	}
+      else
+	{
+	  Entry& c=by_class[it->second];
+	  c.evaluations+=e.evaluations;
+	  c.inclusive+=e.inclusive;
+	  c.exclusive+=e.exclusive;
+	}
+    }
+  std::stable_sort(by_class.begin(),by_class.end(),more_exclusive);
+}
+
+/*! Inclusive times of a class are summed over its nodes, so count time twice where nodes of a class nest.
+ */
+std::ostream& FunctionProfile::report(std::ostream& out,const FunctionNode& root)
+{
+  std::vector<Entry> by_node;
+  std::vector<Entry> by_class;
+  results(root,by_node,by_class);
+
+  out << "By function class:\n";
+  write_table(out,by_class,false);
+  out << "\nBy node:\n";
+  write_table(out,by_node,true);
+  return out;
+}
+
+/*! Otherwise a new node allocated at the same address would inherit the dead one's results (and the tables would grow without limit).
+  A thread part way through an evaluation already holds its own table's lock.
+ */
+void FunctionProfile::forget(const Function& fn)
+{
+  pthread_mutex_lock(&threads_mutex);
+  for (uint i=0;i<threads.size();i++)
+    {
+      const bool locked=(threads[i]==this_thread && this_thread->depth>0);
+      if (!locked) pthread_mutex_lock(&threads[i]->mutex);
+      threads[i]->stats.erase(&fn);
+      if (!locked) pthread_mutex_unlock(&threads[i]->mutex);
+    }
+  pthread_mutex_unlock(&threads_mutex);
+}
+
+void FunctionProfile::reset()
+{
+  pthread_mutex_lock(&threads_mutex);
+  for (uint i=0;i<threads.size();i++)
+    {
+      pthread_mutex_lock(&threads[i]->mutex);
+      threads[i]->stats.clear();
+      pthread_mutex_unlock(&threads[i]->mutex);
+    }
+  pthread_mutex_unlock(&threads_mutex);
+}
@@ -0,0 +1,148 @@
+/**************************************************************************/
+/*  Copyright 2012 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Evolvotron                                       */
+/*                                                                        */
+/*  Evolvotron is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Evolvotron is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Evolvotron.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class FunctionProfile.
+*/
+
+#ifndef _function_profile_h_
+#define _function_profile_h_
+
+class Function;
+class FunctionNode;
+
+//! Opt-in profiler counting evaluations of, and time spent in, each function node.
+/*! When enabled, every evaluation through Function::operator() is counted against its node.
+  Time is only measured for one in sample_interval() top level evaluations (i.e image samples),
+  inclusive (the node and everything below it) and exclusive (less the time in its arguments);
+  reported times are scaled up from those samples.
+  Each thread accumulates into its own table, locked once per top level evaluation
+  (so only ever contended while a report is being made).
+  Tables are keyed by node address, so a node's results are dropped when it's destroyed (see forget());
+  reset() clears everything.
+  Compiled (native code) images don't evaluate through their nodes, so aren't seen by the profiler.
+  There's also a lightweight counting mode, which just counts each thread's evaluations (see evaluations()).
+ */
+class FunctionProfile
+{
+ public:
+
+  //! Results for a node, or for all nodes of a class.
+  struct Entry
+  {
+    Entry()
+      :depth(0)
+      ,evaluations(0)
+      ,inclusive(0.0)
+      ,exclusive(0.0)
+      {}
+
+    //! Function class name.
+    std::string name;
+
+    //! Depth in the tree (for per-node entries).
+    uint depth;
+
+    //! Number of times evaluated.
+    unsigned long long evaluations;
+
+    //! Estimated seconds spent in the node(s), including arguments.
+    double inclusive;
+
+    //! Estimated seconds spent in the node(s) themselves.
+    double exclusive;
+  };
+
+  //! Turn profiling on or off.  Best done before any rendering starts.
+  static void enable(bool e)
+    {
+      _enabled=e;
+      _hooked=(_enabled || _counting);
+    }
+
+  //! Whether profiling is on.
+  static bool enabled()
+    {
+      return _enabled;
+    }
+
+  //! Turn counting of evaluations on or off (profiling counts them too).
+  static void count(bool c)
+    {
+      _counting=c;
+      _hooked=(_enabled || _counting);
+    }
+
+  //! Whether counting is on.
+  static bool counting()
+    {
+      return _counting;
+    }
+
+  //! Whether evaluations need to go through evaluate() below, for profiling or counting.
+  static bool hooked()
+    {
+      return _hooked;
+    }
+
+  //! Number of evaluations by the calling thread while profiling or counting.
+  /*! Only differences are meaningful: e.g the number of evaluations needed for a sample.
+   */
+  static unsigned long long evaluations();
+
+  //! Monotonic clock, in seconds.
+  static double now();
+
+  //! One top level evaluation in this many is timed.
+  static uint sample_interval()
+    {
+      return 16;
+    }
+
+  //! Evaluate a function, accounting for it.  Only used (by Function::operator()) when hooked.
+  static const XYZ evaluate(const Function& fn,const XYZ& p);
+
+  //! Collect results for the nodes of a tree: per node (in depth first order) and per class (most exclusive time first).
+  static void results(const FunctionNode& root,std::vector<Entry>& by_node,std::vector<Entry>& by_class);
+
+  //! Write results for the nodes of a tree as tables.
+  static std::ostream& report(std::ostream& out,const FunctionNode& root);
+
+  //! Forget the results for a node.  Called as each node is destroyed while profiling is on.
+  static void forget(const Function& fn);
+
+  //! Forget all results so far.
+  static void reset();
+
+ private:
+
+  //@{
+  //! Flags read by every evaluation, on any thread, and set from the GUI thread.
+  /*! volatile because used for inter-thread communication, as MutatableImageComputer's flags are.
+    libfunction doesn't use Qt, so there's no atomic type to hand, but the race is benign:
+    a thread seeing a change late only misses counting a few evaluations, and anything queued for the
+    compute threads after a change passes through the farm's lock, which publishes it.
+   */
+  static volatile bool _enabled;  //!< Whether profiling is on.
+  static volatile bool _counting; //!< Whether counting is on.
+  static volatile bool _hooked;   //!< Whether either is.
+  //@}
+};
+
+#endif
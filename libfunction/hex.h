@@ -21,6 +21,9 @@
   \brief Helper functions for hexagons.
 */
 
+#ifndef _hex_h_
+#define _hex_h_
+
 #include "xy.h"
 
 //! Returns cartesian coords of given hex-grid
@@ -28,3 +31,5 @@ const XY hex_coord(int x,int y);
 
 //! Finds integer hex-grid coordinates of hex containing cartesian px,py
 extern const std::pair<int,int> nearest_hex(real px,real py);
+
+#endif
@@ -7,6 +7,9 @@ CONFIG += staticlib
 
 PRECOMPILED_HEADER = libfunction_precompiled.h
 
+# FunctionCompiler's generated kernels are built against the headers (and a few sources) in this directory
+QMAKE_CXXFLAGS += '-DEVOLVOTRON_COMPILER_INCLUDE=$$PWD'
+
 HEADERS += $$system(ls *.h)
 SOURCES += $$system(ls *.cpp)
 
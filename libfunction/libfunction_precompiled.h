@@ -28,6 +28,7 @@
 #include "useful.h"
 #include "xy.h"
 #include "xyz.h"
+#include "function_profile.h"
 #include "function_node.h"
 #include "function_boilerplate.h" 
 
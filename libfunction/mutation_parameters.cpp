@@ -68,6 +68,11 @@ void MutationParameters::reset()
   _base_probability_iterations_change_step=0.25;
   _base_probability_iterations_change_jump=0.02;
 
+  _probe_threshold=0.0;
+
+  _cost_budget=0.0;
+  _parsimony=0.0;
+
   _function_weighting.clear();
   for (
        FunctionRegistry::Registrations::const_iterator it=_function_registry->registrations().begin();
@@ -167,19 +172,16 @@ std::auto_ptr<FunctionNode> MutationParameters::random_function() const
 
 const FunctionRegistration* MutationParameters::random_weighted_function_registration() const
 {  
-  const real r=r01();
-  
-  const std::map<real,const FunctionRegistration*>::const_iterator it=_function_pick.lower_bound(r);
+  assert(!_function_pick.empty());
 
-  // Just in case last key isn't quite 1.0
-  if (it!=_function_pick.end())
-    {
-      return (*it).second;
-    }
+  // Integer part of the scaled random number selects a slot, the fractional part chooses between it and its alias.
+  const real r=r01()*_function_pick.size();
+  const uint i=std::min(static_cast<uint>(r),static_cast<uint>(_function_pick.size()-1));
+
+  if (r-i<_function_pick_probability[i])
+    return _function_pick[i];
   else
-    {
-      return (*(_function_pick.rbegin())).second;
-    }
+    return _function_pick[_function_pick_alias[i]];
 }
 
 real MutationParameters::random_function_branching_ratio() const
@@ -231,6 +233,10 @@ real MutationParameters::get_weighting(const FunctionRegistration* fn)
   return (*it).second;
 }
 
+/*! Builds the alias table using Vose's method:
+  slots are scaled so the mean weight is 1, then each "small" slot (weight<1) is topped up by a "large" one,
+  which becomes its alias and has its own weight reduced accordingly.
+ */
 void MutationParameters::recalculate_function_stuff()
 {
   _function_weighting_total=0.0;
@@ -241,17 +247,57 @@ void MutationParameters::recalculate_function_stuff()
        )
     _function_weighting_total+=(*it).second;
 
-  real normalised=0.0;
+  const uint n=_function_weighting.size();
+
   _function_pick.clear();
+  _function_pick_probability.clear();
+  _function_pick_alias.clear();
+
+  _function_pick.reserve(n);
+  _function_pick_probability.reserve(n);
+  _function_pick_alias.reserve(n);
+
+  std::vector<uint> small;
+  std::vector<uint> large;
+
   for (
        std::map<const FunctionRegistration*,real>::const_iterator it=_function_weighting.begin();
        it!=_function_weighting.end();
        it++
        )
     {
-      normalised+=(*it).second/_function_weighting_total;
-      _function_pick.insert(std::make_pair(normalised,(*it).first));
+      const uint i=_function_pick.size();
+      const real p=(*it).second*n/_function_weighting_total;
+      
+      _function_pick.push_back((*it).first);
+      _function_pick_probability.push_back(p);
+      _function_pick_alias.push_back(i);
+
+      if (p<1.0) small.push_back(i);
+      else large.push_back(i);
+    }
+
+  while (!small.empty() && !large.empty())
+    {
+      const uint s=small.back();
+      small.pop_back();
+      const uint l=large.back();
+
+      _function_pick_alias[s]=l;
+      _function_pick_probability[l]-=(1.0-_function_pick_probability[s]);
+
+      if (_function_pick_probability[l]<1.0)
+	{
+	  large.pop_back();
+	  small.push_back(l);
+	}
     }
+
+  // Anything left over is only off 1.0 by rounding error
+  for (std::vector<uint>::const_iterator it=small.begin();it!=small.end();it++)
+    _function_pick_probability[*it]=1.0;
+  for (std::vector<uint>::const_iterator it=large.begin();it!=large.end();it++)
+    _function_pick_probability[*it]=1.0;
 }
 
 void MutationParameters::report_change()
@@ -86,6 +86,15 @@ class MutationParameters
   //! The base probability of the number of iterations changing by times or divide 2.
   real _base_probability_iterations_change_jump;
 
+  //! Minimum score (0-1) of a low-resolution probe render for a new image to be accepted (0 disables probing).
+  real _probe_threshold;
+
+  //! Maximum estimated seconds per sample of a mutant (0 for no limit): see MutatableImage::mutated.
+  real _cost_budget;
+
+  //! Probability (0-1) of drawing a second mutant and keeping the cheaper.  If non-zero, mutants' constant subtrees are also simplified.
+  real _parsimony;
+
   //! Individual weighting modifiers for each function type
   /*! Will only be applied to random functions we're asked for.
     The bulk of nodes are created by FunctionNode and are boring to keep the branching ratio down.
@@ -96,8 +105,14 @@ class MutationParameters
   //! Total of function weights, for normalisation.
   real _function_weighting_total;
 
-  //! Map from [0,1] to a function registration, taking weights into account.
-  std::map<real,const FunctionRegistration*> _function_pick;
+  //! Function registrations indexed by alias table slot.
+  std::vector<const FunctionRegistration*> _function_pick;
+
+  //! Probability of keeping a slot's own registration rather than taking its alias (Walker/Vose alias method).
+  std::vector<real> _function_pick_probability;
+
+  //! Alias slot used when a slot's own registration isn't kept.
+  std::vector<uint> _function_pick_alias;
 
   //! What state a reset should return autocool to.
   const bool _autocool_reset_state;
@@ -114,6 +129,7 @@ class MutationParameters
   //! Just use SingleChannelNoise for almost all functions (useful for debugging).
   const bool _debug_mode;
 
+  //! Recompute the weighting total and rebuild the alias table from _function_weighting.
   void recalculate_function_stuff();
 
  public:
@@ -292,6 +308,42 @@ class MutationParameters
       report_change();
     }
 
+  //! Accessor.
+  real probe_threshold() const
+    {
+      return _probe_threshold;
+    }
+  //! Accessor.
+  void probe_threshold(real v)
+    {
+      _probe_threshold=v;
+      report_change();
+    }
+
+  //! Accessor.
+  real cost_budget() const
+    {
+      return _cost_budget;
+    }
+  //! Accessor.
+  void cost_budget(real v)
+    {
+      _cost_budget=v;
+      report_change();
+    }
+
+  //! Accessor.
+  real parsimony() const
+    {
+      return _parsimony;
+    }
+  //! Accessor.
+  void parsimony(real v)
+    {
+      _parsimony=v;
+      report_change();
+    }
+
   //! Accessor, with decay.
   real effective_probability_iterations_change_step() const
     {
@@ -397,6 +449,11 @@ class MutationParameters
 
   real get_weighting(const FunctionRegistration* fn);
 
+  //! Return a random function registration, appropriately biased by current settings
+  /*! O(1): one random number and one alias table lookup.
+   */
+  const FunctionRegistration* random_weighted_function_registration() const;
+
  protected:
 
   //! Compute current decay factor
@@ -405,9 +462,6 @@ class MutationParameters
   //! Return a random function appropriately biased by current settings
   std::auto_ptr<FunctionNode> random_function() const;
 
-  //! Return a random function registration, appropriately biased by current settings
-  const FunctionRegistration* random_weighted_function_registration() const;
-
   //! Intended for Qt-world subclass to override to emit signal. 
   virtual void report_change();
 };
@@ -68,6 +68,61 @@ private:
   boost::variate_generator<boost::mt19937,boost::uniform_real<> > _gen;
 };
 
+//! Stateless counter-based generator of numbers in the range [0,1).
+/*! Unlike Random01 there is no sequence state: the value returned is a pure function of the seed and
+  the (x,y,frame,sample) counter, using the "Squares" construction (a few rounds of squaring a 64-bit
+  counter times a key).  This makes sample jitter independent of which thread renders which pixel,
+  so renders with the same seed are reproducible whatever the thread count or fragmenting,
+  and the generator can be shared between threads since operator() is const.
+  Counter fields are packed as 20 bits each of x and y, 12 of frame and 12 of sample index;
+  larger values just wrap (harmless for jitter purposes).
+ */
+class RandomCounter01
+{
+public:
+  //! Constructor.  The key is derived from the seed by a SplitMix64 finaliser and forced odd.
+  RandomCounter01(uint seed)
+    :_key(key(seed))
+    {}
+
+  //! Return the number for the given pixel, frame and sample index.
+  double operator()(uint x,uint y,uint f,uint s) const
+    {
+      const boost::uint64_t ctr
+	=(static_cast<boost::uint64_t>(x&0xfffff))
+	|(static_cast<boost::uint64_t>(y&0xfffff)<<20)
+	|(static_cast<boost::uint64_t>(f&0xfff)<<40)
+	|(static_cast<boost::uint64_t>(s&0xfff)<<52);
+      return squares32(ctr)*(1.0/4294967296.0);
+    }
+
+private:
+
+  //! Key for the Squares rounds.
+  const boost::uint64_t _key;
+
+  //! SplitMix64 finaliser, used to spread seed bits over a key.
+  static boost::uint64_t key(uint seed)
+    {
+      boost::uint64_t z=static_cast<boost::uint64_t>(seed)+0x9e3779b97f4a7c15ULL;
+      z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+      z=(z^(z>>27))*0x94d049bb133111ebULL;
+      return (z^(z>>31))|1;
+    }
+
+  //! Four rounds of the Squares counter-based generator, returning 32 random bits.
+  boost::uint32_t squares32(boost::uint64_t ctr) const
+    {
+      boost::uint64_t x=ctr*_key;
+      const boost::uint64_t y=x;
+      const boost::uint64_t z=y+_key;
+      x=x*x+y; x=(x>>32)|(x<<32);
+      x=x*x+z; x=(x>>32)|(x<<32);
+      x=x*x+y; x=(x>>32)|(x<<32);
+      return static_cast<boost::uint32_t>((x*x+z)>>32);
+    }
+};
+
 //! Return negative-exponentially distributed random numbers.
 class RandomNegExp : public Random
 {
@@ -1,4 +1,4 @@
 TEMPLATE = subdirs
 
-SUBDIRS = libfunction libevolvotron evolvotron evolvotron_render evolvotron_mutate
+SUBDIRS = libfunction libevolvotron evolvotron evolvotron_render evolvotron_mutate evolvotron_benchmark evolvotron_evolve
 